@@ -1,24 +1,57 @@
 ﻿/* SweepOptimizer */
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
-#include <list>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
 #include <string>
-#include <future>
 #include <mutex>
+#include <thread>
 #include <tuple>
+#include <type_traits>
 #include <deque>
 #include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+// x86ではAVX2のカーネルも用意し、使えるかどうかは実行時に判定する
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define SWEEP_AVX2 1
+#define SWEEP_TARGET_AVX2
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SWEEP_AVX2 1
+#define SWEEP_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SWEEP_AVX2 0
+#endif
+#if SWEEP_AVX2
+#include <immintrin.h>
+#endif
+
+// 探索の統計(深さごとのノード数・枝刈りの回数など)を取る場合は1にする
+// 0ならカウンタは空の構造体になり、数える処理ごとコンパイル時に消える
+#ifndef SWEEP_STATS
+#define SWEEP_STATS 0
+#endif
 
 using std::cout;
 using std::endl;
 using std::string;
 using std::vector;
 
-enum Floor : size_t{
+enum Floor : uint16_t{
 	Dirty        = 1,	//拭かれていない床
 	Clean        = 2,	//拭いた床
 	Boy          = 4,	//男の子
@@ -37,20 +70,43 @@ enum Floor : size_t{
 	MustCleanFlg = Dirty | Pool | Apple | Bottle,
 };
 
-struct Status {
-	Floor type_;			//掃除人の種類
-	size_t move_now_;		//現在の歩数
-	size_t move_max_;		//最大歩数
-	size_t position_now_;	//現在の位置
-	size_t position_old_;	//過去の位置
-	size_t position_first_;	//最初の位置
-	size_t stock_;			//リンゴ・ビンの所持数
-	size_t move_max_combo_;		//最大歩数(コンボ用)
-};
-
 const size_t kCleanerTypes = 3;	//掃除人の種類数(男の子・女の子・ロボット)
+const size_t kMaxCleaners = 16;	//掃除人の最大人数
+const size_t kMaxSteps = UINT8_MAX - 2;	//最大歩数の上限(残り歩数が最小移動歩数表のkFarCostより小さく収まるように)
+const size_t kMovesPerWord = 32;	//移動の記録で1語に詰める歩数(1歩2ビット)
+
+// 探索中に変化する掃除人の状態(掃除人の番号順に、項目ごとの配列で持つ)
+// 1人あたり7バイトなので、16人でも112バイト(キャッシュライン2本)に収まる
+struct CleanerState {
+	std::array<uint16_t, kMaxCleaners> position_now_;	//現在の位置
+	std::array<uint16_t, kMaxCleaners> position_old_;	//過去の位置
+	std::array<uint8_t, kMaxCleaners> move_now_;		//現在の歩数
+	std::array<uint8_t, kMaxCleaners> move_end_;		//歩き終える歩数(最大歩数。最適化モードでは途中で止めたり、最良の解に合わせて詰めたりする)
+	std::array<uint8_t, kMaxCleaners> stock_;			//リンゴ・ビンの所持数
+};
 const std::array<Floor, Floor::Types> floor_types{ Floor::Dirty,Floor::Clean,Floor::Boy,Floor::Girl,Floor::Robot,Floor::Pool,Floor::Apple,Floor::Bottle,Floor::DustBox,Floor::RecycleBox,Floor::Obstacle };
 const size_t kDirections = 4;
+const uint16_t kNoCell = UINT16_MAX;	//移動できないマスの通し番号
+const uint8_t kFarCost = UINT8_MAX;	//最小移動歩数表の上限(これ以上は丸める)
+
+// 位置positionから方向d(上・左・右・下の順)へ1歩進んだ位置(xは番兵込みの横幅)
+inline size_t StepPosition(const size_t position, const size_t d, const size_t x) noexcept {
+	switch (d) {
+	case 0:
+		return position - x;
+	case 1:
+		return position - 1;
+	case 2:
+		return position + 1;
+	default:
+		return position + x;
+	}
+}
+
+// 位置positionから隣の位置nextへ進む方向(上・左・右・下を0～3で表す。StepPositionの逆)
+inline size_t StepDirection(const size_t position, const size_t next, const size_t x) noexcept {
+	return next + x == position ? 0 : next + 1 == position ? 1 : next == position + 1 ? 2 : 3;
+}
 
 inline bool CanMoveFloor(const Floor floor) noexcept {
 	return (floor & Floor::CanMoveFlg) != 0;
@@ -60,53 +116,616 @@ inline bool MustCleanFloor(const Floor floor) noexcept {
 	return (floor & Floor::MustCleanFlg) != 0;
 }
 
+inline size_t PopCount(const uint64_t bits) noexcept {
+#if defined(_MSC_VER) && defined(_M_X64)
+	return static_cast<size_t>(__popcnt64(bits));
+#elif defined(__GNUC__)
+	return static_cast<size_t>(__builtin_popcountll(bits));
+#else
+	uint64_t x = bits - ((bits >> 1) & 0x5555555555555555ULL);
+	x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+	x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return static_cast<size_t>((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+inline size_t LowestBit(const uint64_t bits) noexcept {
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanForward64(&index, bits);
+	return index;
+#elif defined(__GNUC__)
+	return static_cast<size_t>(__builtin_ctzll(bits));
+#else
+	size_t index = 0;
+	while (((bits >> index) & 1) == 0) ++index;
+	return index;
+#endif
+}
+
+// 到達人数の表を扱うカーネル(1マス1バイトで、kLanesマスずつまとめて処理する)
+// 配列はkLanesバイト単位で読み書きするので、長さはkLanesの倍数に揃えておくこと
+const size_t kLanes = 32;
+// 各マスを掃除するのに必要な掃除人(汚れはだれでもよく、水たまり・リンゴ・ビンは種類が決まっている)
+const uint8_t kNeedAny = 1, kNeedBoy = 2, kNeedGirl = 4, kNeedRobot = 8;
+
+inline bool HasAvx2() noexcept {
+#if SWEEP_AVX2 && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+	// OSがYMMレジスタを退避してくれるか(OSXSAVEとXCR0)も確かめる
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6) return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#elif SWEEP_AVX2
+	return __builtin_cpu_supports("avx2") != 0;
+#else
+	return false;
+#endif
+}
+const bool g_avx2_flg = HasAvx2();
+
+// 1歩前に残りrest_old歩で届き(row_old <= rest_old)、今は残りrest_now歩で届かない(row_now > rest_now)マスの人数を1減らす(backなら1増やす)
+inline void ReachDeltaScalar(uint8_t *__restrict count, const uint8_t *__restrict row_old, const uint8_t *__restrict row_now, const uint8_t rest_old, const uint8_t rest_now, const bool back, const size_t n) noexcept {
+	const uint8_t delta = (back ? 1 : UINT8_MAX);
+	// 配列が重ならないことを__restrictで伝え、内側を固定長のループにして、コンパイラの自動ベクトル化に任せる
+	for (size_t i = 0; i < n; i += kLanes) {
+		for (size_t k = i; k < i + kLanes; ++k) {
+			const uint8_t lost = static_cast<uint8_t>(-((row_old[k] <= rest_old) & (row_now[k] > rest_now)));
+			count[k] = static_cast<uint8_t>(count[k] + (lost & delta));
+		}
+	}
+}
+// 掃除が必要なマス(need)のうち、必要な種類の掃除人が1人も届かないマスがなければtrue
+inline bool CoveredScalar(const uint8_t *__restrict need, const uint8_t *__restrict boy, const uint8_t *__restrict girl, const uint8_t *__restrict robot, const size_t n) noexcept {
+	for (size_t i = 0; i < n; i += kLanes) {
+		uint8_t lacking = 0;
+		for (size_t k = i; k < i + kLanes; ++k) {
+			const uint8_t reach = (boy[k] != 0 ? kNeedBoy : 0) | (girl[k] != 0 ? kNeedGirl : 0) | (robot[k] != 0 ? kNeedRobot : 0);
+			lacking |= need[k] & ~(reach | (reach != 0 ? kNeedAny : 0));
+		}
+		if (lacking != 0) return false;
+	}
+	return true;
+}
+// 目印ごとの最小移動歩数の差で、下界の行を引き上げる(row[i] = max(row[i], |cost[li][i] - base[li]|)。cost[li]はcost + li * n)
+inline void LandmarkBoundScalar(uint8_t *__restrict row, const uint8_t *__restrict cost, const uint8_t *__restrict base, const size_t landmarks, const size_t n) noexcept {
+	for (size_t li = 0; li < landmarks; ++li) {
+		const uint8_t *__restrict line = cost + li * n;
+		for (size_t i = 0; i < n; i += kLanes) {
+			for (size_t k = i; k < i + kLanes; ++k) {
+				const uint8_t diff = static_cast<uint8_t>(std::max(base[li], line[k]) - std::min(base[li], line[k]));
+				row[k] = std::max(row[k], diff);
+			}
+		}
+	}
+}
+#if SWEEP_AVX2
+SWEEP_TARGET_AVX2 inline void ReachDeltaAvx2(uint8_t *count, const uint8_t *row_old, const uint8_t *row_now, const uint8_t rest_old, const uint8_t rest_now, const bool back, const size_t n) noexcept {
+	const __m256i old_rest = _mm256_set1_epi8(static_cast<char>(rest_old));
+	const __m256i now_rest = _mm256_set1_epi8(static_cast<char>(rest_now));
+	for (size_t i = 0; i < n; i += kLanes) {
+		const __m256i cost_old = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row_old + i));
+		const __m256i cost_now = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row_now + i));
+		// 符号なしの a <= b は min(a, b) == a で求める
+		const __m256i reach_old = _mm256_cmpeq_epi8(_mm256_min_epu8(cost_old, old_rest), cost_old);
+		const __m256i reach_now = _mm256_cmpeq_epi8(_mm256_min_epu8(cost_now, now_rest), cost_now);
+		// 届かなくなったマスは0xFF(=-1)になる
+		const __m256i lost = _mm256_andnot_si256(reach_now, reach_old);
+		auto *target = reinterpret_cast<__m256i*>(count + i);
+		const __m256i value = _mm256_loadu_si256(target);
+		_mm256_storeu_si256(target, back ? _mm256_sub_epi8(value, lost) : _mm256_add_epi8(value, lost));
+	}
+}
+SWEEP_TARGET_AVX2 inline bool CoveredAvx2(const uint8_t *need, const uint8_t *boy, const uint8_t *girl, const uint8_t *robot, const size_t n) noexcept {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i need_any = _mm256_set1_epi8(kNeedAny), need_boy = _mm256_set1_epi8(kNeedBoy);
+	const __m256i need_girl = _mm256_set1_epi8(kNeedGirl), need_robot = _mm256_set1_epi8(kNeedRobot);
+	for (size_t i = 0; i < n; i += kLanes) {
+		// 1人も届かない種類は0xFFになる
+		const __m256i no_boy = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(boy + i)), zero);
+		const __m256i no_girl = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(girl + i)), zero);
+		const __m256i no_robot = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(robot + i)), zero);
+		__m256i lacking = _mm256_and_si256(_mm256_and_si256(no_boy, no_girl), _mm256_and_si256(no_robot, need_any));
+		lacking = _mm256_or_si256(lacking, _mm256_and_si256(no_boy, need_boy));
+		lacking = _mm256_or_si256(lacking, _mm256_and_si256(no_girl, need_girl));
+		lacking = _mm256_or_si256(lacking, _mm256_and_si256(no_robot, need_robot));
+		if (!_mm256_testz_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(need + i)), lacking)) return false;
+	}
+	return true;
+}
+SWEEP_TARGET_AVX2 inline void LandmarkBoundAvx2(uint8_t *row, const uint8_t *cost, const uint8_t *base, const size_t landmarks, const size_t n) noexcept {
+	// 行はレジスタに置いたまま、全目印を重ねてから書き戻す
+	for (size_t i = 0; i < n; i += kLanes) {
+		auto *target = reinterpret_cast<__m256i*>(row + i);
+		__m256i bound = _mm256_loadu_si256(target);
+		for (size_t li = 0; li < landmarks; ++li) {
+			const __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cost + li * n + i));
+			const __m256i base_cost = _mm256_set1_epi8(static_cast<char>(base[li]));
+			// 符号なしの|a - b|は、飽和減算を両向きに行ったもののOR
+			bound = _mm256_max_epu8(bound, _mm256_or_si256(_mm256_subs_epu8(value, base_cost), _mm256_subs_epu8(base_cost, value)));
+		}
+		_mm256_storeu_si256(target, bound);
+	}
+}
+#endif
+inline void ReachDelta(uint8_t *count, const uint8_t *row_old, const uint8_t *row_now, const uint8_t rest_old, const uint8_t rest_now, const bool back, const size_t n) noexcept {
+#if SWEEP_AVX2
+	if (g_avx2_flg) {
+		ReachDeltaAvx2(count, row_old, row_now, rest_old, rest_now, back, n);
+		return;
+	}
+#endif
+	ReachDeltaScalar(count, row_old, row_now, rest_old, rest_now, back, n);
+}
+inline bool CoveredCells(const uint8_t *need, const uint8_t *boy, const uint8_t *girl, const uint8_t *robot, const size_t n) noexcept {
+#if SWEEP_AVX2
+	if (g_avx2_flg) return CoveredAvx2(need, boy, girl, robot, n);
+#endif
+	return CoveredScalar(need, boy, girl, robot, n);
+}
+inline void LandmarkBound(uint8_t *row, const uint8_t *cost, const uint8_t *base, const size_t landmarks, const size_t n) noexcept {
+#if SWEEP_AVX2
+	if (g_avx2_flg) {
+		LandmarkBoundAvx2(row, cost, base, landmarks, n);
+		return;
+	}
+#endif
+	LandmarkBoundScalar(row, cost, base, landmarks, n);
+}
+
+// 番兵込みの盤面(位置 = y * x_ + x)を1マス1ビットで表すビットボード
+// Wordsは64ビット語の数で、盤面の大きさに応じてQueryごとに選ぶ
+template<size_t Words>
+class BitBoard {
+	std::array<uint64_t, Words> bits_;
+public:
+	static const size_t kBits = Words * 64;
+	BitBoard() noexcept : bits_() {}
+	bool Test(const size_t position) const noexcept {
+		return ((bits_[position >> 6] >> (position & 63)) & 1) != 0;
+	}
+	void Set(const size_t position) noexcept {
+		bits_[position >> 6] |= uint64_t(1) << (position & 63);
+	}
+	void Reset(const size_t position) noexcept {
+		bits_[position >> 6] &= ~(uint64_t(1) << (position & 63));
+	}
+	bool Any() const noexcept {
+		uint64_t acc = 0;
+		for (const auto &word : bits_) acc |= word;
+		return acc != 0;
+	}
+	bool None() const noexcept { return !Any(); }
+	size_t Count() const noexcept {
+		size_t count = 0;
+		for (const auto &word : bits_) count += PopCount(word);
+		return count;
+	}
+	BitBoard& operator|=(const BitBoard &other) noexcept {
+		for (size_t wi = 0; wi < Words; ++wi) bits_[wi] |= other.bits_[wi];
+		return *this;
+	}
+	BitBoard& operator&=(const BitBoard &other) noexcept {
+		for (size_t wi = 0; wi < Words; ++wi) bits_[wi] &= other.bits_[wi];
+		return *this;
+	}
+	// *this &= ~other
+	BitBoard& AndNot(const BitBoard &other) noexcept {
+		for (size_t wi = 0; wi < Words; ++wi) bits_[wi] &= ~other.bits_[wi];
+		return *this;
+	}
+	friend BitBoard operator|(BitBoard lhs, const BitBoard &rhs) noexcept { return lhs |= rhs; }
+	friend BitBoard operator&(BitBoard lhs, const BitBoard &rhs) noexcept { return lhs &= rhs; }
+	// 並べ替え・重複除去用の比較(語ごとの辞書順)
+	friend bool operator==(const BitBoard &lhs, const BitBoard &rhs) noexcept { return lhs.bits_ == rhs.bits_; }
+	friend bool operator<(const BitBoard &lhs, const BitBoard &rhs) noexcept { return lhs.bits_ < rhs.bits_; }
+	// 位置が大きくなる方向へnマスずらす
+	BitBoard ShiftUp(const size_t n) const noexcept {
+		BitBoard result;
+		const size_t q = n >> 6, r = n & 63;
+		for (size_t wi = Words; wi-- > q;) {
+			uint64_t word = bits_[wi - q] << r;
+			if (r != 0 && wi > q) word |= bits_[wi - q - 1] >> (64 - r);
+			result.bits_[wi] = word;
+		}
+		return result;
+	}
+	// 位置が小さくなる方向へnマスずらす
+	BitBoard ShiftDown(const size_t n) const noexcept {
+		BitBoard result;
+		const size_t q = n >> 6, r = n & 63;
+		for (size_t wi = 0; wi + q < Words; ++wi) {
+			uint64_t word = bits_[wi + q] >> r;
+			if (r != 0 && wi + q + 1 < Words) word |= bits_[wi + q + 1] << (64 - r);
+			result.bits_[wi] = word;
+		}
+		return result;
+	}
+	// 立っているビットの位置を小さい順に列挙する
+	template<typename Function>
+	void ForEach(Function func) const {
+		for (size_t wi = 0; wi < Words; ++wi) {
+			for (uint64_t word = bits_[wi]; word != 0; word &= word - 1) {
+				func(wi * 64 + LowestBit(word));
+			}
+		}
+	}
+	// 立っている全ビットの位置でpredがtrueならtrue(falseが出た時点で打ち切る)
+	template<typename Predicate>
+	bool AllOf(Predicate pred) const {
+		for (size_t wi = 0; wi < Words; ++wi) {
+			for (uint64_t word = bits_[wi]; word != 0; word &= word - 1) {
+				if (!pred(wi * 64 + LowestBit(word))) return false;
+			}
+		}
+		return true;
+	}
+};
+
+// ワークスティーリング方式のスレッドプール
+// 各ワーカーは自分のdequeの末尾からタスクを取り出し(LIFO)、
+// 暇になったら他のワーカーのdequeの先頭(=根に近い大きな部分木)を盗む
+class WorkStealingPool {
+public:
+	using Task = std::function<void()>;
+private:
+	struct Worker {
+		std::deque<Task> tasks_;
+		std::mutex mutex_;
+	};
+	vector<std::unique_ptr<Worker>> workers_;
+	vector<std::thread> threads_;
+	// 投入済みで未完了のタスク数と、そのうちdequeに積まれていて、まだ誰も取り出していないタスク数
+	std::atomic<size_t> pending_, queued_;
+	// タスクを探している(=暇な)ワーカー数
+	std::atomic<size_t> idle_;
+	std::atomic<bool> stop_;
+	std::mutex sleep_mutex_;
+	std::condition_variable wake_cv_, done_cv_;
+	// 現在のスレッドが担当するワーカー番号(ワーカー以外はSIZE_MAX)
+	static size_t& WorkerIndex() noexcept {
+		static thread_local size_t index = SIZE_MAX;
+		return index;
+	}
+	// 暇なワーカーがいなければ起こさない(queued_を増やしてからidle_を見るので、眠りかけのワーカーは必ずqueued_を見てから眠る)
+	void Push(const size_t wi, Task task) {
+		{
+			std::lock_guard<std::mutex> lock(workers_[wi]->mutex_);
+			workers_[wi]->tasks_.push_back(std::move(task));
+		}
+		++queued_;
+		if (idle_ == 0) return;
+		{
+			std::lock_guard<std::mutex> lock(sleep_mutex_);
+		}
+		wake_cv_.notify_one();
+	}
+	// 自分のdequeの末尾、なければ他人のdequeの先頭から取り出す
+	bool Pop(const size_t wi, Task &task) {
+		{
+			auto &own = *workers_[wi];
+			std::lock_guard<std::mutex> lock(own.mutex_);
+			if (!own.tasks_.empty()) {
+				task = std::move(own.tasks_.back());
+				own.tasks_.pop_back();
+				--queued_;
+				return true;
+			}
+		}
+		for (size_t k = 1; k < workers_.size(); ++k) {
+			auto &victim = *workers_[(wi + k) % workers_.size()];
+			std::lock_guard<std::mutex> lock(victim.mutex_);
+			if (!victim.tasks_.empty()) {
+				task = std::move(victim.tasks_.front());
+				victim.tasks_.pop_front();
+				--queued_;
+				return true;
+			}
+		}
+		return false;
+	}
+	void Run(const size_t wi) {
+		WorkerIndex() = wi;
+		Task task;
+		while (true) {
+			if (Pop(wi, task)) {
+				task();
+				task = nullptr;
+				if (--pending_ == 0) {
+					std::lock_guard<std::mutex> lock(sleep_mutex_);
+					done_cv_.notify_all();
+				}
+				continue;
+			}
+			++idle_;
+			{
+				// 誰かのdequeにタスクが積まれるか、止めるまで眠る
+				std::unique_lock<std::mutex> lock(sleep_mutex_);
+				wake_cv_.wait(lock, [this] { return stop_ || queued_ > 0; });
+				if (stop_) {
+					--idle_;
+					return;
+				}
+			}
+			--idle_;
+		}
+	}
+public:
+	explicit WorkStealingPool(const size_t threads) : pending_(0), queued_(0), idle_(0), stop_(false) {
+		const size_t n = std::max<size_t>(threads, 1);
+		for (size_t wi = 0; wi < n; ++wi) {
+			workers_.push_back(std::make_unique<Worker>());
+		}
+		for (size_t wi = 0; wi < n; ++wi) {
+			threads_.emplace_back([this, wi] { Run(wi); });
+		}
+	}
+	~WorkStealingPool() {
+		{
+			std::lock_guard<std::mutex> lock(sleep_mutex_);
+			stop_ = true;
+		}
+		wake_cv_.notify_all();
+		for (auto &thread : threads_) thread.join();
+	}
+	size_t Size() const noexcept { return workers_.size(); }
+	// タスクを投入する(ワーカー内からなら自分のdequeへ、外からなら順番に配る)
+	void Spawn(Task task) {
+		++pending_;
+		size_t wi = WorkerIndex();
+		if (wi == SIZE_MAX) {
+			static std::atomic<size_t> next(0);
+			wi = next++ % workers_.size();
+		}
+		Push(wi, std::move(task));
+	}
+	// 暇なワーカーがいて、かつ自分のdequeが空なら分割する価値がある
+	bool Hungry() noexcept {
+		if (idle_.load(std::memory_order_relaxed) == 0) return false;
+		const size_t wi = WorkerIndex();
+		if (wi == SIZE_MAX) return true;
+		std::lock_guard<std::mutex> lock(workers_[wi]->mutex_);
+		return workers_[wi]->tasks_.empty();
+	}
+	// 全タスクの完了を待つ
+	void Wait() {
+		std::unique_lock<std::mutex> lock(sleep_mutex_);
+		done_cv_.wait(lock, [this] { return pending_ == 0; });
+	}
+};
+
+// 解けないと分かった局面のZobristハッシュを記録する置換表
+// 全スレッドから共有し、ロックを取らずに読み書きする(2ウェイで、溢れたら2番目を上書き)
+class TranspositionTable {
+	vector<std::atomic<uint64_t>> entries_;
+	size_t mask_;
+	std::atomic<uint64_t> hits_, misses_;
+public:
+	// megabytesで指定した大きさに収まる、2のべき乗個のエントリを確保する(0なら無効)
+	explicit TranspositionTable(const size_t megabytes) : mask_(0), hits_(0), misses_(0) {
+		size_t count = 0;
+		if (megabytes > 0) {
+			count = 2;
+			while (count * 2 * sizeof(uint64_t) <= megabytes * 1024 * 1024) count *= 2;
+		}
+		// 値初期化なので全エントリが0(空き)になる
+		entries_ = vector<std::atomic<uint64_t>>(count);
+		mask_ = count - 1;
+	}
+	bool Enabled() const noexcept { return !entries_.empty(); }
+	void Clear() noexcept {
+		for (auto &entry : entries_) entry.store(0, std::memory_order_relaxed);
+	}
+	// 0は空きを表すので、キーの最下位ビットは常に立てておく
+	bool Contains(uint64_t key) const noexcept {
+		key |= 1;
+		const size_t index = static_cast<size_t>(key >> 1) & mask_;
+		return entries_[index].load(std::memory_order_relaxed) == key
+			|| entries_[index ^ 1].load(std::memory_order_relaxed) == key;
+	}
+	void Insert(uint64_t key) noexcept {
+		key |= 1;
+		const size_t index = static_cast<size_t>(key >> 1) & mask_;
+		const uint64_t first = entries_[index].load(std::memory_order_relaxed);
+		if (first == 0 || first == key) {
+			entries_[index].store(key, std::memory_order_relaxed);
+		}
+		else {
+			entries_[index ^ 1].store(key, std::memory_order_relaxed);
+		}
+	}
+	// 各スレッドで数えたヒット数・ミス数を足し込む
+	void AddStats(const uint64_t hits, const uint64_t misses) noexcept {
+		hits_ += hits;
+		misses_ += misses;
+	}
+	uint64_t Hits() const noexcept { return hits_; }
+	uint64_t Misses() const noexcept { return misses_; }
+};
+
+// 置換表を引くのは残りの深さがこれ以上ある局面だけ(末端近くの小さな部分木は、引くより調べ直す方が速い)
+const size_t kTableMinRest = 2;
+
+// 移動先を試す順番
+enum class MoveOrder : uint8_t {
+	Fixed,			//上・左・右・下の順
+	Clean,			//自分が掃除できるマスへ進む手を先に
+	Nearest,		//自分が掃除できる最寄りのマスへ近づく手を先に
+	Box,			//リンゴ・ビンを持っていればゴミ箱/リサイクル箱へ近づく手を先に(持っていなければNearestと同じ)
+	Constrained,	//届く掃除人が少ないマスを掃除する手を先に
+};
+// --order=で指定する名前(MoveOrderの順)
+const std::array<const char*, 5> kMoveOrderNames{ "fixed", "clean", "near", "box", "constrained" };
+
+// 最適化モードで小さくする量
+enum class Objective : uint8_t {
+	None,		//最適化しない(最初の解で打ち切る)
+	Total,		//全員の歩数の合計
+	Makespan,	//最後の掃除人が歩き終えるまでの歩数
+};
+// --optimize=で指定する名前(Objectiveの順)
+const std::array<const char*, 3> kObjectiveNames{ "none", "total", "makespan" };
+
+// 探索の統計(SWEEP_STATSが0のときは、何も数えない空の実装になる)
+template<bool Enabled>
+struct SearchStats {
+	void Resize(const size_t) noexcept {}
+	void Node(const size_t) noexcept {}
+	void Prune(const size_t, const bool) noexcept {}
+	void SweepedCheck() noexcept {}
+	void Combo(const size_t) noexcept {}
+	void Split(const size_t) noexcept {}
+	void SymmetryCut(const size_t) noexcept {}
+	void Merge(const SearchStats&) noexcept {}
+	void Clear() noexcept {}
+	string ToJson() const { return "{}"; }
+};
+template<>
+struct SearchStats<true> {
+	// 深さごとのノード数・枝刈りを試した回数・枝刈りできた回数
+	vector<uint64_t> nodes_, prune_checks_, prune_hits_;
+	// 解けたか調べた回数・範囲攻撃が起きた回数と消したマス数・他のワーカーに分けた枝の数
+	// ・掃除人を入れ替えただけの局面として調べなかった枝の数
+	uint64_t sweeped_checks_ = 0, combo_triggers_ = 0, combo_cells_ = 0, splits_ = 0, symmetry_cuts_ = 0;
+	void Resize(const size_t depths) {
+		nodes_.resize(depths, 0);
+		prune_checks_.resize(depths, 0);
+		prune_hits_.resize(depths, 0);
+	}
+	void Node(const size_t depth) noexcept { ++nodes_[depth]; }
+	void Prune(const size_t depth, const bool hit) noexcept {
+		++prune_checks_[depth];
+		prune_hits_[depth] += hit;
+	}
+	void SweepedCheck() noexcept { ++sweeped_checks_; }
+	void Combo(const size_t cells) noexcept {
+		++combo_triggers_;
+		combo_cells_ += cells;
+	}
+	void Split(const size_t branches) noexcept { splits_ += branches; }
+	void SymmetryCut(const size_t branches) noexcept { symmetry_cuts_ += branches; }
+	void Merge(const SearchStats &other) {
+		Resize(std::max(nodes_.size(), other.nodes_.size()));
+		for (size_t d = 0; d < other.nodes_.size(); ++d) {
+			nodes_[d] += other.nodes_[d];
+			prune_checks_[d] += other.prune_checks_[d];
+			prune_hits_[d] += other.prune_hits_[d];
+		}
+		sweeped_checks_ += other.sweeped_checks_;
+		combo_triggers_ += other.combo_triggers_;
+		combo_cells_ += other.combo_cells_;
+		splits_ += other.splits_;
+		symmetry_cuts_ += other.symmetry_cuts_;
+	}
+	void Clear() noexcept {
+		std::fill(nodes_.begin(), nodes_.end(), 0);
+		std::fill(prune_checks_.begin(), prune_checks_.end(), 0);
+		std::fill(prune_hits_.begin(), prune_hits_.end(), 0);
+		sweeped_checks_ = combo_triggers_ = combo_cells_ = splits_ = symmetry_cuts_ = 0;
+	}
+	string ToJson() const {
+		std::ostringstream json;
+		json << "{\"sweeped_checks\":" << sweeped_checks_ << ",\"combo_triggers\":" << combo_triggers_
+			<< ",\"combo_cells\":" << combo_cells_ << ",\"splits\":" << splits_ << ",\"symmetry_cuts\":" << symmetry_cuts_ << ",\"depths\":[";
+		for (size_t d = 0; d < nodes_.size(); ++d) {
+			json << (d > 0 ? "," : "") << "{\"depth\":" << d << ",\"nodes\":" << nodes_[d]
+				<< ",\"prune_checks\":" << prune_checks_[d] << ",\"prune_hits\":" << prune_hits_[d] << "}";
+		}
+		json << "]}";
+		return json.str();
+	}
+};
+const bool kStatsEnabled = (SWEEP_STATS != 0);
+
 // 並列処理用
-size_t g_threads = 1;
-std::mutex g_mutex;
-bool g_solved_flg = false;
+WorkStealingPool *g_pool = nullptr;
 
-class Query{
+// 移動できるマスがこれより多い盤面は、マスの組ごとの最小移動歩数表(マス数の2乗バイト)を持たず、目印のマスからの最小移動歩数で下界を求める
+const size_t kLargeBoardCells = 1600;
+// 目印のマスの上限と、掃除人の最初の位置のほかに選ぶ目印の数
+const size_t kMaxLandmarks = kMaxCleaners + 8;
+const size_t kExtraLandmarks = 8;
+
+// 盤面の静的な情報(読み込み後は変更されないので、全探索スレッドで共有する)
+struct Board {
 	// 盤面サイズ
 	size_t x_, y_;
 	size_t x_mini_, y_mini_;
-	// 床の状態
+	// 初期状態の床
 	vector<Floor> floor_;
-	// 掃除人の種類・現在の歩数・最大歩数・現在の位置・過去の位置
-	vector<Status> cleaner_status_;
-	// 各掃除人のスタート位置と終了位置
-	//std::vector<Status>::iterator boy_begin_, boy_end_, girl_begin_, girl_end_, robot_begin_, robot_end_;
+	// 掃除人の人数と、探索中に変化しない掃除人の情報(種類・最大歩数・コンボ用の最大歩数・最初の位置)
+	size_t cleaners_;
+	vector<Floor> cleaner_type_;
+	vector<uint8_t> move_max_;
+	vector<uint16_t> position_first_;
+	// 移動の記録(1歩2ビットでuint64_tに詰める)で、各掃除人が使う先頭の語の位置と、全員分の語数
+	vector<uint16_t> move_log_offset_;
+	size_t move_log_words_;
+	// 入れ替えても区別できない掃除人の組(種類と最大歩数が同じ掃除人のうち、最も小さい番号)
+	vector<uint8_t> cleaner_class_;
 	// 最大歩数の最大
 	size_t max_depth_;
-	// 解答における、各掃除人の移動経路
-	vector<std::list<size_t>> cleaner_move_;
-	// マスA→マスBへの最小移動歩数
-	vector<vector<size_t>> min_cost_;
-	vector<vector<size_t>> min_cost_combo_;	//コンボ用なので上限が緩い
+	// 移動可能なマスの通し番号(移動できないマスはkNoCell)と、その逆引き
+	vector<uint16_t> cell_id_;
+	vector<size_t> cells_;
+	// 通し番号で引く表の1行の長さ(マス数をkLanesの倍数に切り上げたもの)
+	size_t cells_stride_;
+	// マスA→マスBへの最小移動歩数(通し番号の2次元表を、1行cells_stride_個で1次元に詰めたもの)
+	// 255歩以上離れている・たどり着けない場合と、行末の埋め草はkFarCostで、これも下界として扱える
+	// 大きな盤面では空で、代わりに下の目印の表から三角不等式で下界を求める
+	vector<uint8_t> min_cost_;
+	// 大きな盤面か(マスの組ごとの表を持たず、少数の目印のマスからの最小移動歩数だけを持つ)
+	bool landmark_flg_;
+	// 大きな盤面で、掃除人ごとの最初の位置から各マスへの最小移動歩数(1行cells_stride_個)
+	vector<uint8_t> origin_cost_;
+	// 大きな盤面で、目印の数と、目印ごとの各マスへの最小移動歩数(1行cells_stride_個。掃除人の最初の位置も目印に含む)
+	// 盤面は上下左右に行き来できるので、|d(L,A) - d(L,B)| <= d(A,B)がどの目印Lでも成り立つ
+	size_t landmarks_;
+	vector<uint8_t> landmark_cost_;
+	// 各マス(通し番号順)が属する、行き来できるマスの塊の番号(塊が違えばたどり着けない)
+	vector<uint16_t> component_;
+	// 大きな盤面で、掃除人ごとに、最初の位置と同じ塊のマスは0、それ以外のマスと行末の埋め草はkFarCostにした行(下界の行の初期値)
+	vector<uint8_t> component_cost_;
 	// 周囲にゴミ箱/リサイクル箱があったらtrue
 	vector<char> near_dustbox_, near_recyclebox_;
-	// 実行時のスレッド数
-	size_t max_threads_;
-	// 次に移動可能な方向
-	vector<vector<size_t>> next_position_;
+	// 各マス(通し番号順)から、ゴミ箱/リサイクル箱の隣のマスまでの最小移動歩数
+	vector<uint8_t> dustbox_cost_, recyclebox_cost_;
+	// 鉢合わせの静的な解析結果
+	// 歩数tで同じマスにいられるかもしれない相手(番号が大きい方)のビット集合を[t][掃除人]で引く表と、誰かと鉢合わせできる掃除人
+	vector<uint16_t> meet_mask_;
+	vector<char> can_meet_;
+	// 歩数t以降に鉢合わせが起こりうるか(範囲攻撃がもう起きないなら、鉢合わせを考慮しない場合と同じ枝刈りが使える)
+	vector<char> meet_ahead_;
+	// マスA→マスBを掃除するまでの最小移動歩数(Bが汚れた床なら、Bを範囲に含む鉢合わせ地点へ行くだけでもよい)
+	// 鉢合わせできるマスがない場合と大きな盤面では空(min_cost_と同じ形)
+	vector<uint8_t> combo_cost_;
+	// 汚れた床と、それを範囲に含む鉢合わせ地点の組(通し番号。大きな盤面ではcombo_cost_の代わりにこれから行を作る)
+	vector<std::pair<uint16_t, uint16_t>> combo_link_;
+	// 次に移動可能な方向(上・左・右・下の順に1ビットずつ)
+	vector<uint8_t> next_direction_;
 	// マップの位置を記録する変数
 	vector<size_t> position_;
-public:
-	// コンストラクタ
-	Query(const char file_name[], const size_t max_threads){
-		max_threads_ = max_threads;
-		std::ifstream fin;
-		fin.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		fin.open(file_name);
+	// Zobristハッシュ用の乱数
+	// 床は[種類(汚れ・水たまり・リンゴ・ビン)][位置]、掃除人は[組][位置]、所持数は[組][個数]
+	vector<uint64_t> zobrist_floor_, zobrist_now_, zobrist_old_, zobrist_stock_, zobrist_depth_;
+	size_t max_stock_;
+	// コンストラクタ(ストリームから1問ぶん読み込む)
+	// landmark_flgなら、小さな盤面でも大きな盤面と同じく目印のマスで下界を求める
+	explicit Board(std::istream &fin, const bool landmark_flg = false){
 		// 盤面サイズを読み込む
 		size_t x, y;
 		fin >> x >> y;
 		x_mini_ = x; y_mini_ = y;
 		x_ = x + 2; y_ = y + 2;	//番兵用に拡張する
+		// 位置は16ビットで持つ
+		if (x_ * y_ >= kNoCell) throw std::runtime_error("盤面が大きすぎます.");
 		floor_.resize(x_ * y_, Floor::Obstacle);
-		next_position_.resize(x_ * y_, vector<size_t>());
+		next_direction_.resize(x_ * y_, 0);
 		// 盤面データを読み込み、反映させる
-		vector<vector<Status>> cleaner_status_temp;
-		cleaner_status_temp.resize(kCleanerTypes);
+		std::array<vector<uint16_t>, kCleanerTypes> cleaner_position_temp;
 		for (size_t j = 1; j <= y; ++j) {
 			for (size_t i = 1; i <= x; ++i) {
 				size_t temp;
@@ -116,15 +735,15 @@ public:
 				position_.push_back(position);
 				switch (floor_[position] = floor_types[temp]) {
 				case Floor::Boy:
-					cleaner_status_temp[0].push_back(Status{ Floor::Boy, 0, 0, position, position, position, 0});
+					cleaner_position_temp[0].push_back(static_cast<uint16_t>(position));
 					floor_[position] = Floor::Clean;
 					break;
 				case Floor::Girl:
-					cleaner_status_temp[1].push_back(Status{ Floor::Girl, 0, 0, position, position, position, 0 });
+					cleaner_position_temp[1].push_back(static_cast<uint16_t>(position));
 					floor_[position] = Floor::Clean;
 					break;
 				case Floor::Robot:
-					cleaner_status_temp[2].push_back(Status{ Floor::Robot, 0, 0, position, position, position, 0 });
+					cleaner_position_temp[2].push_back(static_cast<uint16_t>(position));
 					floor_[position] = Floor::Clean;
 					break;
 				default:
@@ -133,71 +752,58 @@ public:
 			}
 		}
 		for (const auto& position : position_) {
-			for (const auto &next_position : { position - x_, position - 1, position + 1, position + x_ }) {
-				if (!CanMoveFloor(floor_[next_position])) continue;
-				next_position_[position].push_back(next_position);
+			for (size_t d = 0; d < kDirections; ++d) {
+				if (!CanMoveFloor(floor_[StepPosition(position, d, x_)])) continue;
+				next_direction_[position] |= static_cast<uint8_t>(1 << d);
 			}
 		}
 		// 掃除人データを読み込み、反映させる
 		max_depth_ = 0;
+		const std::array<Floor, kCleanerTypes> cleaner_types{ Floor::Boy, Floor::Girl, Floor::Robot };
 		for(size_t ti = 0; ti < kCleanerTypes; ++ti){
 			size_t temp;
 			fin >> temp;
-			if(cleaner_status_temp[ti].size() != temp){
-				cout << "問題データに誤りがあります." << endl;
-				throw;
+			if(cleaner_position_temp[ti].size() != temp){
+				throw std::runtime_error("問題データに誤りがあります.");
 			}
-			for(size_t ci = 0; ci < cleaner_status_temp[ti].size(); ++ci){
+			for(const auto &position : cleaner_position_temp[ti]){
 				fin >> temp;
-				cleaner_status_temp[ti][ci].move_max_ = temp;
-				cleaner_status_temp[ti][ci].move_max_combo_ = temp + 2;
+				if (temp > kMaxSteps) throw std::runtime_error("最大歩数が大きすぎます.");
+				cleaner_type_.push_back(cleaner_types[ti]);
+				move_max_.push_back(static_cast<uint8_t>(temp));
+				position_first_.push_back(position);
 				max_depth_ = std::max(max_depth_, temp);
 			}
 		}
-		for (const auto &it_t : cleaner_status_temp) {
-			for (const auto &it_c : it_t) {
-				cleaner_status_.push_back(it_c);
-			}
-		}
-		/*boy_begin_ = cleaner_status_.begin();
-		boy_end_ = boy_begin_ + cleaner_status_temp[0].size();
-		girl_begin_ = boy_end_;
-		girl_end_ = girl_begin_ + cleaner_status_temp[1].size();
-		robot_begin_ = girl_end_;
-		robot_end_ = robot_begin_ + cleaner_status_temp[2].size();*/
-		cleaner_move_.resize(cleaner_status_.size());
-		// 事前に最小移動歩数を計算しておく(ワーシャル・フロイド法)
-		min_cost_.resize(x_ * y_);
-		const size_t kMaxMoveCost = x_ * y_ + 1;
-		for (size_t k = 0; k < x_ * y_; ++k) {
-			min_cost_[k].resize(x_ * y_, kMaxMoveCost);
-		}
-		for (size_t iy = 1; iy <= y; ++iy) {
-			for (size_t ix = 1; ix <= x; ++ix) {
-				size_t i = iy * x_ + ix;
-				if (!CanMoveFloor(floor_[i])) continue;
-				for (size_t jy = 1; jy <= y; ++jy) {
-					for (size_t jx = 1; jx <= x; ++jx) {
-						size_t j = jy * x_ + jx;
-						if (!CanMoveFloor(floor_[j])) continue;
-						if (i == j) {
-							 min_cost_[i][j] = 0;
-							continue;
-						}
-						if (i + 1 == j || j + 1 == i || i + x_ == j || j + x_ == i) {
-							min_cost_[i][j] = 1;
-							continue;
-						}
-					}
-				}
-			}
+		cleaners_ = cleaner_type_.size();
+		if (cleaners_ > kMaxCleaners) throw std::runtime_error("掃除人が多すぎます.");
+		move_log_words_ = 0;
+		for (size_t ci = 0; ci < cleaners_; ++ci) {
+			move_log_offset_.push_back(static_cast<uint16_t>(move_log_words_));
+			move_log_words_ += (move_max_[ci] + kMovesPerWord - 1) / kMovesPerWord;
 		}
-		for (size_t i = 0; i < x_ * y_; ++i) {
-			for (size_t j = 0; j < x_ * y_; ++j) {
-				for (size_t k = 0; k < x_ * y_; ++k) {
-					min_cost_[j][k] = std::min(min_cost_[j][k], min_cost_[j][i] + min_cost_[i][k]);
-				}
-			}
+		for (size_t cj = 0; cj < cleaners_; ++cj) {
+			size_t ci = 0;
+			while (cleaner_type_[ci] != cleaner_type_[cj] || move_max_[ci] != move_max_[cj]) ++ci;
+			cleaner_class_.push_back(static_cast<uint8_t>(ci));
+		}
+		// 移動可能なマスに詰めた番号を振る
+		cell_id_.resize(x_ * y_, kNoCell);
+		for (const auto& position : position_) {
+			if (!CanMoveFloor(floor_[position])) continue;
+			cell_id_[position] = static_cast<uint16_t>(cells_.size());
+			cells_.push_back(position);
+		}
+		// 事前に最小移動歩数を計算しておく(小さな盤面では移動可能なマスごとに、大きな盤面では目印のマスごとに幅優先探索)
+		const size_t cells = cells_.size();
+		cells_stride_ = std::max<size_t>((cells + kLanes - 1) / kLanes, 1) * kLanes;
+		landmark_flg_ = landmark_flg || cells > kLargeBoardCells;
+		if (landmark_flg_) {
+			ComputeLandmarks();
+		}
+		else {
+			min_cost_.resize(cells * cells_stride_, kFarCost);
+			for (size_t source = 0; source < cells; ++source) ComputeCost({ source }, &min_cost_[source * cells_stride_]);
 		}
 		// 事前に周囲にゴミ箱/リサイクル箱があるかを判定しておく
 		near_dustbox_.resize(x_ * y_, 0);
@@ -216,17 +822,688 @@ public:
 				near_recyclebox_[position] = 1;
 			}
 		}
+		// 行き来は対称なので、箱の隣のマス全部から幅優先探索すれば、各マスから最寄りの箱の隣までの歩数になる
+		vector<size_t> near_dustbox_cells, near_recyclebox_cells;
+		for (size_t cell = 0; cell < cells; ++cell) {
+			if (near_dustbox_[cells_[cell]] != 0) near_dustbox_cells.push_back(cell);
+			if (near_recyclebox_[cells_[cell]] != 0) near_recyclebox_cells.push_back(cell);
+		}
+		dustbox_cost_.resize(cells_stride_, kFarCost);
+		recyclebox_cost_.resize(cells_stride_, kFarCost);
+		ComputeCost(near_dustbox_cells, dustbox_cost_.data());
+		ComputeCost(near_recyclebox_cells, recyclebox_cost_.data());
+		AnalyzeMeeting();
+		// Zobristハッシュ用の乱数を用意する(所持数はリンゴ・ビンの総数までしか増えない)
+		max_stock_ = 0;
+		for (const auto& position : position_) {
+			if (floor_[position] == Floor::Apple || floor_[position] == Floor::Bottle) ++max_stock_;
+		}
+		if (max_stock_ > UINT8_MAX) throw std::runtime_error("リンゴ・ビンが多すぎます.");
+		uint64_t seed = 0x5357454550ULL;
+		const auto random = [&seed] {
+			// splitmix64
+			uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+			return z ^ (z >> 31);
+		};
+		const auto fill = [&random](vector<uint64_t> &keys, const size_t size) {
+			keys.resize(size);
+			for (auto &key : keys) key = random();
+		};
+		fill(zobrist_floor_, 4 * x_ * y_);
+		fill(zobrist_now_, cleaners_ * x_ * y_);
+		fill(zobrist_old_, cleaners_ * x_ * y_);
+		fill(zobrist_stock_, cleaners_ * (max_stock_ + 1));
+		fill(zobrist_depth_, max_depth_ + 1);
+	}
+	// sourcesのマス(通し番号)のどれかから各マスへの最小移動歩数をrowに書く(幅優先探索。rowはcells_stride_個で、届かないマスはkFarCost)
+	void ComputeCost(const vector<size_t> &sources, uint8_t *row) const {
+		std::fill(row, row + cells_stride_, kFarCost);
+		vector<size_t> queue;
+		queue.reserve(cells_.size());
+		for (const auto source : sources) {
+			row[source] = 0;
+			queue.push_back(source);
+		}
+		for (size_t head = 0; head < queue.size(); ++head) {
+			const size_t now = queue[head];
+			if (row[now] + 1 >= kFarCost) break;
+			for (size_t d = 0; d < kDirections; ++d) {
+				if (((next_direction_[cells_[now]] >> d) & 1) == 0) continue;
+				const size_t next = cell_id_[StepPosition(cells_[now], d, x_)];
+				if (row[next] != kFarCost) continue;
+				row[next] = static_cast<uint8_t>(row[now] + 1);
+				queue.push_back(next);
+			}
+		}
+	}
+	// 大きな盤面で、行き来できるマスの塊と、目印のマスからの最小移動歩数を求める
+	// 目印は掃除人の最初の位置と、既にある目印から最も遠いマスを順にkExtraLandmarks個(遠いマスほど、三角不等式の下界が締まりやすい)
+	void ComputeLandmarks() {
+		const size_t cells = cells_.size();
+		component_.assign(cells, 0);
+		uint16_t components = 0;
+		vector<uint8_t> row(cells_stride_);
+		vector<char> seen(cells, 0);
+		for (size_t cell = 0; cell < cells; ++cell) {
+			if (seen[cell] != 0) continue;
+			// 最小移動歩数はkFarCostで頭打ちになるので、塊は歩数とは別に塗り分ける
+			vector<size_t> stack{ cell };
+			seen[cell] = 1;
+			while (!stack.empty()) {
+				const size_t now = stack.back();
+				stack.pop_back();
+				component_[now] = components;
+				for (size_t d = 0; d < kDirections; ++d) {
+					if (((next_direction_[cells_[now]] >> d) & 1) == 0) continue;
+					const size_t next = cell_id_[StepPosition(cells_[now], d, x_)];
+					if (seen[next] != 0) continue;
+					seen[next] = 1;
+					stack.push_back(next);
+				}
+			}
+			++components;
+		}
+		origin_cost_.resize(cleaners_ * cells_stride_);
+		component_cost_.assign(cleaners_ * cells_stride_, kFarCost);
+		for (size_t ci = 0; ci < cleaners_; ++ci) {
+			const uint16_t part = component_[cell_id_[position_first_[ci]]];
+			for (size_t cell = 0; cell < cells; ++cell) {
+				if (component_[cell] == part) component_cost_[ci * cells_stride_ + cell] = 0;
+			}
+		}
+		landmarks_ = 0;
+		landmark_cost_.reserve(kMaxLandmarks * cells_stride_);
+		// 既にある目印のどれかからの最小移動歩数の最小(たどり着けないマスはkFarCostのまま)
+		vector<uint8_t> nearest(cells, kFarCost);
+		const auto add_landmark = [this, &nearest](const uint8_t *cost) {
+			landmark_cost_.insert(landmark_cost_.end(), cost, cost + cells_stride_);
+			++landmarks_;
+			for (size_t cell = 0; cell < nearest.size(); ++cell) nearest[cell] = std::min(nearest[cell], cost[cell]);
+		};
+		for (size_t ci = 0; ci < cleaners_; ++ci) {
+			auto *cost = &origin_cost_[ci * cells_stride_];
+			ComputeCost({ cell_id_[position_first_[ci]] }, cost);
+			if (nearest[cell_id_[position_first_[ci]]] != 0) add_landmark(cost);
+		}
+		for (size_t li = 0; li < kExtraLandmarks && landmarks_ < kMaxLandmarks; ++li) {
+			const size_t farthest = std::max_element(nearest.begin(), nearest.end()) - nearest.begin();
+			if (cells == 0 || nearest[farthest] == 0) break;
+			ComputeCost({ farthest }, row.data());
+			add_landmark(row.data());
+		}
+	}
+	// 2人の掃除人が同じ歩数で同じマスにいられるかを、最小移動歩数と偶奇だけから調べる
+	// (盤面は市松模様に塗り分けられるので、マスに着く歩数の偶奇は決まっている。余分な歩数で回り道できるかは問わない)
+	void AnalyzeMeeting() {
+		const size_t cells = cells_.size();
+		meet_mask_.assign((max_depth_ + 1) * kMaxCleaners, 0);
+		can_meet_.assign(cleaners_, 0);
+		meet_ahead_.assign(max_depth_ + 2, 0);
+		vector<char> meet_cell(cells, 0);
+		for (size_t ci = 0; ci < cleaners_; ++ci) {
+			const auto *cost_i = OriginCostRow(ci);
+			for (size_t cj = ci + 1; cj < cleaners_; ++cj) {
+				const auto *cost_j = OriginCostRow(cj);
+				const size_t limit = std::min(move_max_[ci], move_max_[cj]);
+				// 歩数の偶奇ごとに、最も早く鉢合わせできる歩数
+				std::array<size_t, 2> earliest{ SIZE_MAX, SIZE_MAX };
+				for (size_t cell = 0; cell < cells; ++cell) {
+					if ((cost_i[cell] - cost_j[cell]) % 2 != 0) continue;
+					const size_t arrive = std::max(cost_i[cell], cost_j[cell]);
+					if (arrive == 0 || arrive > limit) continue;
+					earliest[arrive % 2] = std::min(earliest[arrive % 2], arrive);
+					meet_cell[cell] = 1;
+				}
+				for (size_t step = 1; step <= limit; ++step) {
+					if (step < earliest[step % 2]) continue;
+					meet_mask_[step * kMaxCleaners + ci] |= static_cast<uint16_t>(1 << cj);
+					can_meet_[ci] = can_meet_[cj] = 1;
+					meet_ahead_[step] = 1;
+				}
+			}
+		}
+		for (size_t step = max_depth_; step > 0; --step) {
+			meet_ahead_[step - 1] |= meet_ahead_[step];
+		}
+		if (meet_ahead_[0] == 0) return;
+		// 汚れた床は、周囲8マスのどこかで鉢合わせれば範囲攻撃で消える
+		for (size_t target = 0; target < cells; ++target) {
+			const size_t position = cells_[target];
+			if (floor_[position] != Floor::Dirty) continue;
+			for (const auto offset : { x_ + 1, x_, x_ - 1, size_t(1) }) {
+				for (const size_t center : { position - offset, position + offset }) {
+					const size_t cell = cell_id_[center];
+					if (cell == kNoCell || meet_cell[cell] == 0) continue;
+					combo_link_.emplace_back(static_cast<uint16_t>(target), static_cast<uint16_t>(cell));
+				}
+			}
+		}
+		if (landmark_flg_) return;
+		combo_cost_ = min_cost_;
+		for (const auto &link : combo_link_) {
+			for (size_t source = 0; source < cells; ++source) {
+				auto &cost = combo_cost_[source * cells_stride_ + link.first];
+				cost = std::min(cost, min_cost_[source * cells_stride_ + link.second]);
+			}
+		}
+	}
+	// 床の状態に対応する乱数(掃除しなくてもいい床は0)
+	uint64_t ZobristFloor(const Floor floor, const size_t position) const noexcept {
+		switch (floor) {
+		case Floor::Dirty:
+			return zobrist_floor_[position];
+		case Floor::Pool:
+			return zobrist_floor_[x_ * y_ + position];
+		case Floor::Apple:
+			return zobrist_floor_[2 * x_ * y_ + position];
+		case Floor::Bottle:
+			return zobrist_floor_[3 * x_ * y_ + position];
+		default:
+			return 0;
+		}
+	}
+	// 掃除人の位置・過去の位置・所持数に対応する乱数(入れ替えても区別できない掃除人どうしは同じ乱数表を使う)
+	uint64_t ZobristCleaner(const size_t ci, const CleanerState &cleaner) const noexcept {
+		const size_t k = cleaner_class_[ci];
+		return zobrist_now_[k * x_ * y_ + cleaner.position_now_[ci]]
+			^ zobrist_old_[k * x_ * y_ + cleaner.position_old_[ci]]
+			^ zobrist_stock_[k * (max_stock_ + 1) + cleaner.stock_[ci]];
+	}
+	// マスA→マスBへの最小移動歩数(大きな盤面では下界)
+	size_t MinCost(const size_t position_a, const size_t position_b) const noexcept {
+		return CellCost(cell_id_[position_a], cell_id_[position_b]);
+	}
+	// マス(通し番号)source→targetへの最小移動歩数(大きな盤面では、目印ごとの差の最大を下界とする)
+	uint8_t CellCost(const size_t source, const size_t target) const noexcept {
+		if (!landmark_flg_) return min_cost_[source * cells_stride_ + target];
+		if (component_[source] != component_[target]) return kFarCost;
+		uint8_t cost = 0;
+		for (size_t li = 0; li < landmarks_; ++li) {
+			const uint8_t a = landmark_cost_[li * cells_stride_ + source], b = landmark_cost_[li * cells_stride_ + target];
+			cost = std::max<uint8_t>(cost, a > b ? a - b : b - a);
+		}
+		return cost;
+	}
+	// マスAから各マス(通し番号順、cells_stride_個)への最小移動歩数(大きな盤面では使えないので、FillCostRowで作る)
+	const uint8_t* MinCostRow(const size_t position) const noexcept {
+		return &min_cost_[cell_id_[position] * cells_stride_];
+	}
+	// 掃除人ciの最初の位置から各マスへの最小移動歩数(大きな盤面でも正確な値)
+	const uint8_t* OriginCostRow(const size_t ci) const noexcept {
+		return landmark_flg_ ? &origin_cost_[ci * cells_stride_] : MinCostRow(position_first_[ci]);
+	}
+	// 大きな盤面で、掃除人ciがいるマスAから各マスへの最小移動歩数の下界をrow(cells_stride_個)に書く
+	// 掃除人の最初の位置なら正確な値を写す。最初の位置も目印なので、隣のマスとの下界の差はどちらの場合も1以内に収まる
+	void FillCostRow(const size_t ci, const size_t position, uint8_t *row) const noexcept {
+		for (size_t cj = 0; cj < cleaners_; ++cj) {
+			if (position_first_[cj] != position) continue;
+			std::copy_n(&origin_cost_[cj * cells_stride_], cells_stride_, row);
+			return;
+		}
+		// 掃除人は最初の位置と同じ塊から出られないので、ほかの塊のマスはたどり着けないものとして始める
+		const size_t source = cell_id_[position];
+		std::copy_n(&component_cost_[ci * cells_stride_], cells_stride_, row);
+		std::array<uint8_t, kMaxLandmarks> base;
+		for (size_t li = 0; li < landmarks_; ++li) base[li] = landmark_cost_[li * cells_stride_ + source];
+		LandmarkBound(row, landmark_cost_.data(), base.data(), landmarks_, cells_stride_);
+	}
+	// 大きな盤面で、最小移動歩数の行costから、鉢合わせを考慮する場合の行(ComboCostRowと同じ意味)をrowに作る
+	void FillComboCostRow(const uint8_t *cost, uint8_t *row) const noexcept {
+		std::copy_n(cost, cells_stride_, row);
+		for (const auto &link : combo_link_) row[link.first] = std::min(row[link.first], cost[link.second]);
+	}
+	// 鉢合わせを考慮する場合の、マスAから各マスを掃除するまでの最小移動歩数(combo_cost_が空ならmin_cost_と同じ)
+	const uint8_t* ComboCostRow(const size_t position) const noexcept {
+		return combo_cost_.empty() ? MinCostRow(position) : &combo_cost_[cell_id_[position] * cells_stride_];
+	}
+	// 掃除人ciが掃除しうるマス(通し番号順)
+	// 最初の位置から最大歩数で届くマスのうち種類が合うものと、鉢合わせできるなら、最大歩数で届く鉢合わせ地点の範囲攻撃で消える汚れた床
+	vector<char> CleanableCells(const size_t ci) const {
+		const size_t cells = cells_.size();
+		const auto *cost = OriginCostRow(ci);
+		const Floor item = (cleaner_type_[ci] == Floor::Boy ? Floor::Pool : cleaner_type_[ci] == Floor::Girl ? Floor::Apple : Floor::Bottle);
+		vector<char> cleanable(cells, 0);
+		for (size_t cell = 0; cell < cells; ++cell) {
+			const Floor floor = floor_[cells_[cell]];
+			if ((floor == Floor::Dirty || floor == item) && cost[cell] <= move_max_[ci]) cleanable[cell] = 1;
+		}
+		if (can_meet_[ci] == 0) return cleanable;
+		for (const auto &link : combo_link_) {
+			if (cost[link.second] <= move_max_[ci]) cleanable[link.first] = 1;
+		}
+		return cleanable;
+	}
+	// 掃除人を、同じマスを掃除しうる者どうしが同じ組になるように分ける(組ごとの掃除人の番号。組は最も小さい番号の順)
+	// 組が違えば掃除するマスも鉢合わせもかち合わないので、組ごとに別々に解いてつなぎ合わせればよい
+	// 誰も掃除できないマスがあれば解けないので、分けずに全員を1組にして返す
+	vector<vector<size_t>> Decompose() const {
+		const size_t cells = cells_.size();
+		std::array<size_t, kMaxCleaners> parent;
+		for (size_t ci = 0; ci < cleaners_; ++ci) parent[ci] = ci;
+		const auto root = [&parent](size_t ci) {
+			while (parent[ci] != ci) ci = parent[ci] = parent[parent[ci]];
+			return ci;
+		};
+		// 各マスを掃除しうると最初に分かった掃除人(いなければkMaxCleaners)
+		vector<size_t> owner(cells, kMaxCleaners);
+		for (size_t ci = 0; ci < cleaners_; ++ci) {
+			const auto cleanable = CleanableCells(ci);
+			for (size_t cell = 0; cell < cells; ++cell) {
+				if (cleanable[cell] == 0) continue;
+				if (owner[cell] == kMaxCleaners) owner[cell] = ci;
+				else parent[root(ci)] = root(owner[cell]);
+			}
+		}
+		vector<vector<size_t>> groups;
+		for (size_t cell = 0; cell < cells; ++cell) {
+			if (MustCleanFloor(floor_[cells_[cell]]) && owner[cell] == kMaxCleaners) groups.resize(1);
+		}
+		if (!groups.empty()) {
+			for (size_t ci = 0; ci < cleaners_; ++ci) groups[0].push_back(ci);
+			return groups;
+		}
+		std::array<size_t, kMaxCleaners> group_id;
+		for (size_t ci = 0; ci < cleaners_; ++ci) {
+			const size_t top = root(ci);
+			if (top == ci) {
+				group_id[ci] = groups.size();
+				groups.emplace_back();
+			}
+			groups[group_id[top]].push_back(ci);
+		}
+		return groups;
+	}
+	// 掃除人members(番号の昇順)だけを残した部分問題
+	// ほかの掃除人の最初の位置と、membersの誰も掃除しえないマスは拭いた床にする(盤面の大きさは変えないので、同じビットボードで解ける)
+	std::shared_ptr<const Board> SubBoard(const vector<size_t> &members) const {
+		vector<char> keep(cells_.size(), 0);
+		for (const auto ci : members) {
+			const auto cleanable = CleanableCells(ci);
+			for (size_t cell = 0; cell < cleanable.size(); ++cell) keep[cell] |= cleanable[cell];
+		}
+		const auto type_index = [](const Floor floor) {
+			return static_cast<size_t>(std::find(floor_types.begin(), floor_types.end(), floor) - floor_types.begin());
+		};
+		// 問題ファイルと同じ形式に書き出して読み直す
+		std::ostringstream text;
+		text << x_mini_ << " " << y_mini_ << "\n";
+		for (size_t j = 1; j <= y_mini_; ++j) {
+			for (size_t i = 1; i <= x_mini_; ++i) {
+				const size_t position = j * x_ + i;
+				Floor floor = floor_[position];
+				if (MustCleanFloor(floor) && keep[cell_id_[position]] == 0) floor = Floor::Clean;
+				for (const auto ci : members) {
+					if (position_first_[ci] == position) floor = cleaner_type_[ci];
+				}
+				text << type_index(floor) << (i < x_mini_ ? " " : "\n");
+			}
+		}
+		for (const auto type : { Floor::Boy, Floor::Girl, Floor::Robot }) {
+			vector<size_t> move_max;
+			for (const auto ci : members) {
+				if (cleaner_type_[ci] == type) move_max.push_back(move_max_[ci]);
+			}
+			text << move_max.size();
+			for (const auto step : move_max) text << " " << step;
+			text << "\n";
+		}
+		std::istringstream fin(text.str());
+		return std::make_shared<const Board>(fin, landmark_flg_);
+	}
+	// 解答(MoveCodesの形式)を、探索とは別に最初の盤面から規則どおり歩かせ直して確かめる(正しければ空文字列、誤りならその理由)
+	// 歩数ごとに番号順で1歩ずつ進め、鉢合わせを考慮するならその歩数で歩いた者どうしの範囲攻撃も行う
+	// full_flgなら、全員が最大歩数ちょうど歩いていなければ誤り(最適化モード以外)
+	string CheckAnswer(const string &codes, const bool combo_flg, const bool full_flg) const {
+		vector<string> moves(1);
+		for (const char code : codes) {
+			if (code == ',') moves.emplace_back();
+			else moves.back() += code;
+		}
+		if (moves.size() != std::max<size_t>(cleaners_, 1)) return "掃除人の人数が合いません";
+		size_t depth = 0;
+		for (size_t ci = 0; ci < cleaners_; ++ci) {
+			if (moves[ci].size() > move_max_[ci] || (full_flg && moves[ci].size() != move_max_[ci])) {
+				return "掃除人" + std::to_string(ci) + "の歩数(" + std::to_string(moves[ci].size()) + ")が合いません";
+			}
+			depth = std::max(depth, moves[ci].size());
+		}
+		auto floor = floor_;
+		vector<size_t> position(position_first_.begin(), position_first_.end()), position_old(position), stock(cleaners_, 0);
+		const auto near = [this, &floor](const size_t center, const Floor box) {
+			for (size_t d = 0; d < kDirections; ++d) {
+				if (floor[StepPosition(center, d, x_)] == box) return true;
+			}
+			return false;
+		};
+		for (size_t step = 0; step < depth; ++step) {
+			for (size_t ci = 0; ci < cleaners_; ++ci) {
+				if (step >= moves[ci].size()) continue;
+				const size_t d = string("ULRD").find(moves[ci][step]);
+				if (d == string::npos) return "掃除人" + std::to_string(ci) + "の" + std::to_string(step + 1) + "歩目の向きが読めません";
+				const size_t next = StepPosition(position[ci], d, x_);
+				const string where = "掃除人" + std::to_string(ci) + "の" + std::to_string(step + 1) + "歩目" + GetPos(next);
+				if (!CanMoveFloor(floor[next])) return where + "は移動できないマスです";
+				if (step > 0 && next == position_old[ci]) return where + "はすぐ前にいたマスです";
+				position_old[ci] = position[ci];
+				position[ci] = next;
+				// 周囲に捨て場所があれば、拾うより先に捨てる
+				const Floor type = cleaner_type_[ci];
+				if ((type == Floor::Girl && near(next, Floor::DustBox)) || (type == Floor::Robot && near(next, Floor::RecycleBox))) stock[ci] = 0;
+				const Floor here = floor[next];
+				if (here == Floor::Dirty || (here == Floor::Pool && type == Floor::Boy)) {
+					floor[next] = Floor::Clean;
+				}
+				else if ((here == Floor::Apple && type == Floor::Girl) || (here == Floor::Bottle && type == Floor::Robot)) {
+					floor[next] = Floor::Clean;
+					++stock[ci];
+				}
+			}
+			if (!combo_flg) continue;
+			for (size_t ci1 = 0; ci1 < cleaners_; ++ci1) {
+				for (size_t ci2 = ci1 + 1; ci2 < cleaners_; ++ci2) {
+					if (step >= moves[ci1].size() || step >= moves[ci2].size() || position[ci1] != position[ci2]) continue;
+					// 範囲攻撃で、周囲3x3の汚れた床を消す
+					for (size_t j = position[ci1] - x_; j <= position[ci1] + x_; j += x_) {
+						for (size_t i = j - 1; i <= j + 1; ++i) {
+							if (floor[i] == Floor::Dirty) floor[i] = Floor::Clean;
+						}
+					}
+				}
+			}
+		}
+		for (const auto cell : position_) {
+			if (MustCleanFloor(floor[cell])) return GetPos(cell) + "が掃除されていません";
+		}
+		for (size_t ci = 0; ci < cleaners_; ++ci) {
+			if (stock[ci] != 0) return "掃除人" + std::to_string(ci) + "がリンゴ・ビンを捨てきっていません";
+		}
+		return "";
 	}
 	// ヘルパー関数
 	string GetPos(const size_t position) const{
 		return "[" + std::to_string(position % x_ - 1) + "," + std::to_string(position / x_ - 1) + "]";
 	}
+};
+
+template<size_t Words, size_t Width>
+class Query;
+
+// 同じ問題を解く複数の探索を、まとめて打ち切るための取り消しトークン
+// (ポートフォリオモードで、どれかが解けたら残りを止める。各探索は時計を見るついでに確かめる)
+class CancelToken {
+	std::atomic<bool> cancelled_;
+public:
+	CancelToken() : cancelled_(false) {}
+	void Cancel() noexcept { cancelled_.store(true, std::memory_order_release); }
+	bool Cancelled() const noexcept { return cancelled_.load(std::memory_order_acquire); }
+};
+
+// 1問ぶんの探索の状態(複数の問題を同じスレッドプールで同時に解くため、問題ごとに持つ)
+template<size_t Words, size_t Width>
+struct SearchContext {
+	// 置換表(nullptrなら使わない)と、前回の探索で使った置換表を空にせず引き継ぐか
+	// (分担探索で同じ鉢合わせの扱いの手順を続けて探索する場合、手順はどれも同じ探索の枝なので、解けない局面の記録はそのまま使える)
+	TranspositionTable *table_;
+	bool keep_table_flg_;
+	// 探索を打ち切るか(解けた・時間切れ)
+	std::atomic<bool> stop_flg_;
+	// 時間切れになる時刻
+	std::chrono::high_resolution_clock::time_point deadline_;
+	// 他の探索と一緒に打ち切るための取り消しトークン(nullptrなら使わない)
+	CancelToken *cancel_;
+	// 移動先を試す順番
+	MoveOrder order_;
+	// 鉢合わせを考慮しない場合に被覆エンジンを使うか
+	bool cover_flg_;
+	// 解を全部数えるか(数える場合は解けても打ち切らない)と、数える上限(0なら無制限)・見つけた解を1行ずつ書き出す先(nullptrなら書かない)
+	bool count_flg_;
+	uint64_t solution_limit_;
+	std::ostream *solution_out_;
+	// 見つけた解の数(各タスクが手元で数えた分を足し込む)
+	std::atomic<uint64_t> solutions_;
+	// 最適化モードで小さくする量(Noneなら最初の解で打ち切る)と、これまでに見つけた最良の解のコスト(なければSIZE_MAX)
+	// 最良の解のコストはReset()では戻さないので、鉢合わせを考慮しない探索の結果を、考慮する探索の上限として持ち越せる
+	Objective objective_;
+	std::atomic<size_t> best_cost_;
+	// 分担探索で手順を書き出す深さ(SIZE_MAXなら書き出さない)と、書き出した手順
+	// 手順は、全員がこの深さまで進んで枝刈りを通った局面までの移動の列(MoveCodesの形式)で、探索順に並ぶ
+	size_t prefix_depth_;
+	vector<string> prefixes_;
+	// この問題のタスクのうち、投入済みで未完了のもの
+	std::atomic<size_t> pending_;
+	// 探索したノード数と、枝刈りを試した回数・枝刈りできた回数(進捗表示のため、探索中も一定ノードごとに足し込まれる)
+	std::atomic<uint64_t> nodes_, prune_checks_, prune_hits_;
+	// 各タスクの統計をまとめたもの(mutex_で守る)
+	SearchStats<kStatsEnabled> stats_;
+	// 最初に解けた盤面(最適化モードでは最良の解)を置く解答欄
+	std::mutex mutex_;
+	std::unique_ptr<Query<Words, Width>> answer_;
+	// 最後のタスクが終わったときに、そのワーカー上で呼ばれる
+	std::function<void()> on_finish_;
+	explicit SearchContext(TranspositionTable *table)
+		: table_(table), keep_table_flg_(false), stop_flg_(false), deadline_(std::chrono::high_resolution_clock::time_point::max()), cancel_(nullptr), order_(MoveOrder::Fixed), cover_flg_(false), count_flg_(false), solution_limit_(0), solution_out_(nullptr), solutions_(0), objective_(Objective::None), best_cost_(SIZE_MAX), prefix_depth_(SIZE_MAX), pending_(0), nodes_(0), prune_checks_(0), prune_hits_(0) {}
+	// 制限時間を設定する(0なら無制限)
+	void SetLimit(const size_t limit_ms) {
+		deadline_ = (limit_ms == 0 ? std::chrono::high_resolution_clock::time_point::max()
+			: std::chrono::high_resolution_clock::now() + std::chrono::milliseconds(limit_ms));
+	}
+	bool Expired() const noexcept {
+		return std::chrono::high_resolution_clock::now() >= deadline_;
+	}
+	// 取り消しトークンで打ち切られたか
+	bool Cancelled() const noexcept {
+		return cancel_ != nullptr && cancel_->Cancelled();
+	}
+	// 同じ問題をもう一度探索するために、解答欄と打ち切りの状態を空にする
+	void Reset() {
+		stop_flg_ = false;
+		solutions_ = 0;
+		answer_.reset();
+	}
+};
+
+// 自分しか届かないマスを2マスずつ組にして調べるのは、この数のマスまで
+const size_t kExclusivePairCells = 8;
+
+// 被覆エンジンで1人あたりに列挙する経路の上限(これを超える問題は深さ優先探索で解く)
+const size_t kCoverMaxPaths = 1 << 20;
+// 被覆エンジンは移動の列を1歩2ビットでuint64_tに詰めるので、最大歩数がこれ以下の問題だけで使う
+const size_t kCoverMaxSteps = 32;
+// 他の経路に含まれる経路を除く処理は2乗の手間がかかるので、経路の種類がこの数以下のときだけ行う
+// (列挙の上限kCoverMaxPathsまで行うと最悪2^39回の比較になる。一方で8192まで下げると、bench/corpus.txtのgen-8x8-aでもこの処理を飛ばすことになり、
+// 組み合わせの探索が16倍ほど遅くなる)
+const size_t kCoverDominanceMax = 1 << 16;
+
+// 分担探索で書き出す手順の上限
+const size_t kMaxPrefixes = 1 << 16;
+
+// 時計を見るのは、ノードをこの数(2のべき乗)だけ探索するごと
+const uint64_t kClockInterval = 1 << 14;
+
+template<size_t Words, size_t Width>
+class Query{
+	// 手を戻すための記録の種類(床・掃除人の1歩・所持数・ハッシュ値・歩き終える歩数)
+	enum class TrailType : uint8_t { Cell, Step, Stock, Hash, End };
+	// 手を戻すための記録(どこを書き換えたかと、書き換える前の値)
+	struct Trail {
+		TrailType type_;
+		size_t index_;
+		uint64_t value_;
+	};
+	// 被覆エンジンで列挙した経路の表(組み合わせ探索のタスクで共有する)
+	struct CoverTable {
+		// [掃除人][経路]ごとの、掃除できるマスと移動の列(1歩2ビットで、上・左・右・下を0～3で表す)
+		vector<vector<BitBoard<Words>>> cover_;
+		vector<vector<uint64_t>> route_;
+		// [掃除人][マス(通し番号)]ごとの、そのマスを掃除できる経路の番号
+		vector<vector<vector<uint32_t>>> holder_;
+		// 掃除人ごとの、全経路で掃除できるマスの和集合
+		vector<BitBoard<Words>> reach_;
+		// マス(通し番号)ごとの、そのマスを掃除できる経路の総数
+		vector<size_t> holders_;
+		// 掃除しなければならないマス
+		BitBoard<Words> required_;
+		// 最初に埋めるマスを掃除できる(掃除人, 経路)の組(これを区切って各タスクに分ける)
+		vector<std::pair<size_t, uint32_t>> first_;
+		// まだ終わっていない組み合わせ探索のタスク数
+		std::atomic<size_t> pending_;
+	};
+	// 経路を列挙するときの、掃除人ごとに決まる情報と列挙した経路
+	struct PathWalk {
+		Floor type_;
+		// 掃除できるマスと、そのうち拾って運ぶもの(リンゴ・ビン)
+		BitBoard<Words> cleanable_, items_;
+		// 拾ったものを捨てられるマス(男の子はnullptr)
+		const vector<char> *near_box_;
+		vector<std::pair<BitBoard<Words>, uint64_t>> paths_;
+	};
+	// 盤面の静的な情報
+	std::shared_ptr<const Board> board_;
+	// 番兵込みの横幅(Widthを指定して特殊化した場合はコンパイル時定数になる)
+	size_t X() const noexcept {
+		return Width != 0 ? Width : board_->x_;
+	}
+	// 床の状態(掃除しなければならないマスを種類ごとにビットボードで持つ)
+	BitBoard<Words> dirty_, pool_, apple_, bottle_;
+	// 掃除人の現在の位置・過去の位置・現在の歩数・歩き終える歩数・所持数(種類や最大歩数はboard_側に持つ)
+	CleanerState cleaner_;
+	// 解答における、各掃除人の移動の向き(StepPositionの方向を1歩2ビットで、掃除人ごとにboard_->move_log_offset_から詰める)
+	// 大きさは最大歩数で決まるので、探索中に確保し直すことはない
+	vector<uint64_t> move_log_;
+	// 各深さの開始時点で、自分より番号が小さくて入れ替えても区別できない掃除人の番号+1(いなければ0)
+	// 深さごとにkMaxCleaners個ずつ並べる
+	vector<uint8_t> twin_;
+	// 床の状態のZobristハッシュ(掃除人と深さは置換表を引くときに混ぜる)
+	uint64_t hash_;
+	// この問題の探索の状態
+	SearchContext<Words, Width> *context_;
+	// 置換表(nullptrなら使わない)と、このスレッドで数えたヒット数・ミス数・ノード数・枝刈りの回数
+	TranspositionTable *table_;
+	uint64_t table_hits_, table_misses_, nodes_, prune_checks_, prune_hits_;
+	// このタスクで数えた探索の統計
+	SearchStats<kStatsEnabled> stats_;
+	// この局面から他のワーカーに分けた回数(分けた部分木は解けないと断定できない)
+	size_t splits_;
+	// 解を全部数える場合に、このタスクで見つけた解の数と、そのうち探索の状態に足し込んだ数
+	// (途中で解が見つかった部分木も、解けないとは記録できない)
+	uint64_t solutions_, solutions_flushed_;
+	// 鉢合わせを考慮して探索しているか
+	bool combo_flg_;
+	// 移動先を試す順番
+	MoveOrder order_;
+	// 最適化モードで小さくする量(Noneなら最初の解で打ち切る)
+	Objective objective_;
+	// 各マス(通し番号順)に残り歩数で届く掃除人の人数を、種類(男の子・女の子・ロボット)ごとにcells_stride_個ずつ並べたもの
+	vector<uint8_t> reach_count_;
+	// 各マス(通し番号順)を掃除するのに必要な掃除人(kNeedAnyなどの組み合わせ)
+	vector<uint8_t> need_;
+	// 大きな盤面で、各掃除人の今の位置から各マスへの最小移動歩数の下界(cells_stride_個ずつ。小さな盤面では空)と、行を作るための作業領域
+	vector<uint8_t> cost_rows_, row_buffer_;
+	// 書き換えた床・掃除人・ハッシュ値の記録(戻すときは積んだ逆順に戻す)
+	vector<Trail> trail_;
+public:
+	// コンストラクタ
+	explicit Query(std::shared_ptr<const Board> board)
+		: board_(std::move(board)), cleaner_(), need_(board_->cells_stride_, 0) {
+		for (const auto& position : board_->position_) {
+			if (board_->cell_id_[position] == kNoCell) continue;
+			SetFloor(position, board_->floor_[position]);
+		}
+		move_log_.assign(board_->move_log_words_, 0);
+		size_t move_sum = 0;
+		for (size_t ci = 0; ci < board_->cleaners_; ++ci) {
+			cleaner_.position_now_[ci] = cleaner_.position_old_[ci] = board_->position_first_[ci];
+			cleaner_.move_end_[ci] = board_->move_max_[ci];
+			move_sum += board_->move_max_[ci];
+		}
+		// 1歩ごとに高々3件(ハッシュ値・1歩・所持数)、床は1マスにつき高々1件、範囲攻撃のハッシュ値は深さごとに1件、
+		// 最適化モードで歩き終える歩数を縮めるのは深さごとに1人1件
+		trail_.reserve(3 * move_sum + board_->position_.size() + (board_->cleaners_ + 1) * (board_->max_depth_ + 1));
+		hash_ = ComputeHash();
+		context_ = nullptr;
+		table_ = nullptr;
+		table_hits_ = table_misses_ = nodes_ = prune_checks_ = prune_hits_ = 0;
+		stats_.Resize(board_->max_depth_ + 1);
+		twin_.resize((board_->max_depth_ + 1) * kMaxCleaners, 0);
+		splits_ = 0;
+		solutions_ = solutions_flushed_ = 0;
+		combo_flg_ = false;
+		order_ = MoveOrder::Fixed;
+		objective_ = Objective::None;
+		if (board_->landmark_flg_) {
+			cost_rows_.resize(board_->cleaners_ * board_->cells_stride_);
+			row_buffer_.resize(3 * board_->cells_stride_);
+		}
+		InitReachCount();
+	}
+	// 床のZobristハッシュを一から計算する
+	uint64_t ComputeHash() const noexcept {
+		uint64_t hash = 0;
+		MustClean().ForEach([this, &hash](const size_t position) {
+			hash ^= board_->ZobristFloor(FloorAt(position), position);
+		});
+		return hash;
+	}
+	// 置換表のキー(床のハッシュ値に、掃除人と深さの乱数を混ぜる)
+	// 掃除人の乱数はXORではなく足し算で混ぜるので、区別できない2人が同じ状態でも打ち消し合わず、
+	// 2人を入れ替えただけの局面は同じキーになる
+	uint64_t TableKey(const size_t depth) const noexcept {
+		uint64_t cleaner_hash = 0;
+		for (size_t ci = 0; ci < board_->cleaners_; ++ci) {
+			cleaner_hash += board_->ZobristCleaner(ci, cleaner_);
+		}
+		return hash_ ^ cleaner_hash ^ board_->zobrist_depth_[depth];
+	}
+	// 指定したマスの床の状態
+	Floor FloorAt(const size_t position) const noexcept {
+		if (dirty_.Test(position)) return Floor::Dirty;
+		if (pool_.Test(position)) return Floor::Pool;
+		if (apple_.Test(position)) return Floor::Apple;
+		if (bottle_.Test(position)) return Floor::Bottle;
+		const auto floor = board_->floor_[position];
+		return MustCleanFloor(floor) ? Floor::Clean : floor;
+	}
+	// 指定したマスの床の状態を書き換える(hash_は呼び出し側で戻す)
+	void SetFloor(const size_t position, const Floor floor) noexcept {
+		dirty_.Reset(position);
+		pool_.Reset(position);
+		apple_.Reset(position);
+		bottle_.Reset(position);
+		auto &need = need_[board_->cell_id_[position]];
+		switch (floor) {
+		case Floor::Dirty:
+			dirty_.Set(position);
+			need = kNeedAny;
+			break;
+		case Floor::Pool:
+			pool_.Set(position);
+			need = kNeedBoy;
+			break;
+		case Floor::Apple:
+			apple_.Set(position);
+			need = kNeedGirl;
+			break;
+		case Floor::Bottle:
+			bottle_.Set(position);
+			need = kNeedRobot;
+			break;
+		default:
+			need = 0;
+			break;
+		}
+	}
+	// 掃除しなければならないマス
+	BitBoard<Words> MustClean() const noexcept {
+		return dirty_ | pool_ | apple_ | bottle_;
+	}
 	// 盤面表示
 	void Put() const noexcept{
-		cout << "横" << x_mini_ << "マス,縦" << y_mini_ << "マス" << endl;
-		for(size_t j = 1; j <= y_mini_; ++j){
-			for(size_t i = 1; i <= x_mini_; ++i){
-				switch (floor_[j * x_ + i]) {
+		cout << "横" << board_->x_mini_ << "マス,縦" << board_->y_mini_ << "マス" << endl;
+		for(size_t j = 1; j <= board_->y_mini_; ++j){
+			for(size_t i = 1; i <= board_->x_mini_; ++i){
+				switch (FloorAt(j * board_->x_ + i)) {
 				case Floor::Dirty:
 					cout << "□";
 					break;
@@ -264,11 +1541,11 @@ public:
 			}
 			cout << endl;
 		}
-		for (auto &it_c : cleaner_status_) {
-			auto type = it_c.type_;
-			auto position = it_c.position_now_;
-			auto move_now = it_c.move_now_;
-			auto move_max = it_c.move_max_;
+		for (size_t ci = 0; ci < board_->cleaners_; ++ci) {
+			auto type = board_->cleaner_type_[ci];
+			size_t position = cleaner_.position_now_[ci];
+			size_t move_now = cleaner_.move_now_[ci];
+			size_t move_max = board_->move_max_[ci];
 			switch (type) {
 			case Floor::Boy:
 				cout << "男の子";
@@ -280,222 +1557,632 @@ public:
 				cout << "Robot";
 				break;
 			}
-			cout << GetPos(position) << "(" << move_now << "/" << move_max << ")歩 ";
+			cout << board_->GetPos(position) << "(" << move_now << "/" << move_max << ")歩 ";
 		}
 		cout << endl;
 	}
 	// 終了判定
 	bool Sweeped() const noexcept{
-		for (const auto& position : position_) {
-			if (MustCleanFloor(floor_[position])) return false;
-		}
-		for (const auto &it_c : cleaner_status_) {
-			if (it_c.stock_ != 0) return false;
+		if (MustClean().Any()) return false;
+		for (size_t ci = 0; ci < board_->cleaners_; ++ci) {
+			if (cleaner_.stock_[ci] != 0) return false;
 		}
 		return true;
 	}
-	// 現状では拭ききれない場合はfalse
-	bool CanMoveWithCombo() const noexcept {
-		for (const auto& position : position_) {
-			// 拭かなくてもいいマスは無視する
-			const auto &cell = floor_[position];
-			if (!MustCleanFloor(cell)) continue;
-			// 拭く必要がある場合は調査する
-			// 全従業員を走査して、いずれもその床を磨けない場合はcan_move_flg = falseのまま
-			bool can_move_flg = false;
-			for (const auto &it_c : cleaner_status_) {
-				// 磨けない要因：
-				// ・歩数の関係で行けない
-				// ・水たまりだが自分は男の子じゃない
-				// ・リンゴだが自分は女の子じゃない
-				// ・ビンだが自分はロボットじゃない
-				if ((min_cost_[position][it_c.position_now_] + it_c.move_now_ > it_c.move_max_combo_)
-					|| (cell == Floor::Pool && it_c.type_ != Floor::Boy)
-					|| (cell == Floor::Apple && it_c.type_ != Floor::Girl)
-					|| (cell == Floor::Bottle && it_c.type_ != Floor::Robot)) continue;
-				can_move_flg = true;
+	// 1歩で掃除できるのは1マスだけなので、残り歩数の合計が足りなければ拭ききれない
+	// (コンボがあると1歩で複数マス消えるので、鉢合わせを考慮しない場合専用)
+	bool EnoughSteps() const noexcept {
+		std::array<size_t, kCleanerTypes> rest{};
+		for (size_t ci = 0; ci < board_->cleaners_; ++ci) {
+			const size_t steps = cleaner_.move_end_[ci] - cleaner_.move_now_[ci];
+			switch (board_->cleaner_type_[ci]) {
+			case Floor::Boy:
+				rest[0] += steps;
+				break;
+			case Floor::Girl:
+				rest[1] += steps;
+				break;
+			case Floor::Robot:
+				rest[2] += steps;
+				break;
+			default:
 				break;
 			}
-			if (!can_move_flg) return false;
 		}
-		return true;
+		if (pool_.Count() > rest[0] || apple_.Count() > rest[1] || bottle_.Count() > rest[2]) return false;
+		return MustClean().Count() <= rest[0] + rest[1] + rest[2];
 	}
-	bool CanMoveNonCombo() const noexcept {
-		for (const auto& position : position_) {
-			// 拭かなくてもいいマスは無視する
-			const auto &cell = floor_[position];
-			if (!MustCleanFloor(cell)) continue;
-			// 拭く必要がある場合は調査する
-			bool can_move_flg = false;
-			for (const auto &it_c : cleaner_status_) {
-				// 磨けない要因：
-				// ・歩数の関係で行けない
-				// ・水たまりだが自分は男の子じゃない
-				// ・リンゴだが自分は女の子じゃない
-				// ・ビンだが自分はロボットじゃない
-				if ((min_cost_[position][it_c.position_now_] + it_c.move_now_ > it_c.move_max_)
-					|| (cell == Floor::Pool && it_c.type_ != Floor::Boy)
-					|| (cell == Floor::Apple && it_c.type_ != Floor::Girl)
-					|| (cell == Floor::Bottle && it_c.type_ != Floor::Robot)) continue;
-				can_move_flg = true;
-				break;
+	// 掃除人の種類の番号(男の子・女の子・ロボットの順)
+	static size_t TypeIndex(const Floor type) noexcept {
+		return type == Floor::Boy ? 0 : type == Floor::Girl ? 1 : 2;
+	}
+	// 掃除人がいるマスから各マスを掃除するまでの最小移動歩数
+	// (鉢合わせを考慮する場合、誰かと鉢合わせできる掃除人は範囲攻撃で汚れた床を消せるとみなす)
+	const uint8_t* ReachRow(const size_t ci, const size_t position) const noexcept {
+		return combo_flg_ && board_->can_meet_[ci] != 0 ? board_->ComboCostRow(position) : board_->MinCostRow(position);
+	}
+	// 掃除人ciの今の位置から各マスへの最小移動歩数(大きな盤面では下界)
+	const uint8_t* CostRow(const size_t ci) const noexcept {
+		return board_->landmark_flg_ ? &cost_rows_[ci * board_->cells_stride_] : board_->MinCostRow(cleaner_.position_now_[ci]);
+	}
+	// 掃除人ciの今の位置からのReachRow(大きな盤面では手元の行から作るので、鉢合わせを考慮する場合はbufferに書く)
+	const uint8_t* CurrentReachRow(const size_t ci, uint8_t *buffer) const noexcept {
+		if (!board_->landmark_flg_) return ReachRow(ci, cleaner_.position_now_[ci]);
+		if (!(combo_flg_ && board_->can_meet_[ci] != 0)) return CostRow(ci);
+		board_->FillComboCostRow(CostRow(ci), buffer);
+		return buffer;
+	}
+	// 残り歩数(最小移動歩数表に合わせてkFarCostで頭打ちにする)
+	static uint8_t RestCost(const size_t rest) noexcept {
+		return static_cast<uint8_t>(std::min<size_t>(rest, kFarCost));
+	}
+	// 各マスに届く掃除人の人数を一から数え直す
+	void InitReachCount() {
+		const size_t stride = board_->cells_stride_;
+		reach_count_.assign(kCleanerTypes * stride, 0);
+		for (size_t ci = 0; ci < board_->cleaners_; ++ci) {
+			if (board_->landmark_flg_) board_->FillCostRow(ci, cleaner_.position_now_[ci], &cost_rows_[ci * stride]);
+			auto *count = &reach_count_[TypeIndex(board_->cleaner_type_[ci]) * stride];
+			const auto *min_cost = CurrentReachRow(ci, row_buffer_.data());
+			const uint8_t rest = RestCost(cleaner_.move_end_[ci] - cleaner_.move_now_[ci]);
+			for (size_t i = 0; i < stride; ++i) {
+				count[i] += (min_cost[i] <= rest);
+			}
+		}
+	}
+	// 掃除人がposition_oldからposition_nowへ1歩進んだときに、届かなくなったマスの人数を減らす(backならその逆)
+	// 1歩進むと残り歩数も1減り、隣のマスとの距離の差は1以内なので、届くマスは減る一方になる
+	// 大きな盤面では、動いた先(backなら戻った先)の行を作って手元の行と比べ、手元の行も置き換える
+	void UpdateReachCount(const size_t ci, const size_t position_old, const size_t position_now, const size_t move_old, const bool back) noexcept {
+		const size_t stride = board_->cells_stride_;
+		if (board_->landmark_flg_) {
+			auto *cache = &cost_rows_[ci * stride];
+			auto *fresh = row_buffer_.data();
+			board_->FillCostRow(ci, back ? position_old : position_now, fresh);
+			const uint8_t *row_old = (back ? fresh : cache), *row_now = (back ? cache : fresh);
+			if (combo_flg_ && board_->can_meet_[ci] != 0) {
+				board_->FillComboCostRow(row_old, &row_buffer_[stride]);
+				board_->FillComboCostRow(row_now, &row_buffer_[2 * stride]);
+				row_old = &row_buffer_[stride];
+				row_now = &row_buffer_[2 * stride];
+			}
+			ReachDelta(&reach_count_[TypeIndex(board_->cleaner_type_[ci]) * stride], row_old, row_now,
+				RestCost(cleaner_.move_end_[ci] - move_old), RestCost(cleaner_.move_end_[ci] - move_old - 1), back, stride);
+			std::copy_n(fresh, stride, cache);
+			return;
+		}
+		ReachDelta(&reach_count_[TypeIndex(board_->cleaner_type_[ci]) * stride], ReachRow(ci, position_old), ReachRow(ci, position_now),
+			RestCost(cleaner_.move_end_[ci] - move_old), RestCost(cleaner_.move_end_[ci] - move_old - 1), back, stride);
+	}
+	// 掃除しなければならない全マスに、まだ届く掃除人が1人以上いるか
+	// (水たまりは男の子、リンゴは女の子、ビンはロボットしか磨けない)
+	bool Covered() const noexcept {
+		const size_t stride = board_->cells_stride_;
+		return CoveredCells(need_.data(), &reach_count_[0], &reach_count_[stride], &reach_count_[2 * stride], stride);
+	}
+	// マス(通し番号)cellの、needで指定した掃除人のうち残り歩数で届く人数
+	uint32_t Reachers(const size_t cell, const uint8_t need) const noexcept {
+		const size_t stride = board_->cells_stride_;
+		uint32_t reach = 0;
+		if ((need & (kNeedAny | kNeedBoy)) != 0) reach += reach_count_[cell];
+		if ((need & (kNeedAny | kNeedGirl)) != 0) reach += reach_count_[stride + cell];
+		if ((need & (kNeedAny | kNeedRobot)) != 0) reach += reach_count_[2 * stride + cell];
+		return reach;
+	}
+	// マス(通し番号)cellでリンゴ・ビンを拾ってから、捨てられるマスへ着くまでの最小移動歩数
+	// (捨ててから拾うので、拾ったマスが箱の隣でももう1歩要る)
+	size_t DisposeCost(const Floor type, const size_t cell) const noexcept {
+		return std::max<size_t>((type == Floor::Girl ? board_->dustbox_cost_ : board_->recyclebox_cost_)[cell], 1);
+	}
+	// 持っているリンゴ・ビンと、まだ落ちているリンゴ・ビンを、残り歩数のうちに捨てられるか
+	// (拾うにも捨てるにも実際に歩く必要があるので、鉢合わせを考慮する場合も最大歩数で数える)
+	bool CanDispose() const noexcept {
+		for (size_t ci = 0; ci < board_->cleaners_; ++ci) {
+			if (cleaner_.stock_[ci] == 0) continue;
+			const size_t cell = board_->cell_id_[cleaner_.position_now_[ci]];
+			if (DisposeCost(board_->cleaner_type_[ci], cell) > size_t(cleaner_.move_end_[ci] - cleaner_.move_now_[ci])) return false;
+		}
+		const auto disposable = [this](const Floor type, const size_t position) {
+			const size_t cell = board_->cell_id_[position];
+			const size_t cost = DisposeCost(type, cell);
+			for (size_t ci = 0; ci < board_->cleaners_; ++ci) {
+				if (board_->cleaner_type_[ci] != type) continue;
+				if (CostRow(ci)[cell] + cost <= size_t(cleaner_.move_end_[ci] - cleaner_.move_now_[ci])) return true;
+			}
+			return false;
+		};
+		return apple_.AllOf([&disposable](const size_t position) { return disposable(Floor::Girl, position); })
+			&& bottle_.AllOf([&disposable](const size_t position) { return disposable(Floor::Robot, position); });
+	}
+	// 自分しか届かないマスは自分で回るしかないので、その数と、そのうち2マスを回る最短の歩数が残り歩数に収まるか
+	// (combo_aheadなら、範囲攻撃で消えうる汚れた床を除く)
+	bool CanVisitExclusive(const bool combo_ahead) const noexcept {
+		const size_t stride = board_->cells_stride_;
+		for (size_t ci = 0; ci < board_->cleaners_; ++ci) {
+			const size_t rest = cleaner_.move_end_[ci] - cleaner_.move_now_[ci];
+			const uint8_t reach = RestCost(rest);
+			const uint8_t mask = NeedMask(board_->cleaner_type_[ci]);
+			const auto *min_cost = CostRow(ci);
+			// 2マスずつの組は、先に見つかったkExclusivePairCells個の中だけで調べる
+			std::array<size_t, kExclusivePairCells> cells;
+			size_t count = 0;
+			for (size_t i = 0; i < stride; ++i) {
+				const uint8_t need = need_[i] & mask;
+				if (need == 0 || min_cost[i] > reach) continue;
+				if (combo_ahead && need_[i] == kNeedAny) continue;
+				if (Reachers(i, need_[i]) != 1) continue;
+				if (count < kExclusivePairCells) cells[count] = i;
+				if (++count > rest) return false;
+			}
+			count = std::min(count, kExclusivePairCells);
+			for (size_t a = 0; a + 1 < count; ++a) {
+				for (size_t b = a + 1; b < count; ++b) {
+					const size_t via = board_->CellCost(cells[a], cells[b]);
+					if (std::min(min_cost[cells[a]], min_cost[cells[b]]) + via > rest) return false;
+				}
 			}
-			if (!can_move_flg) return false;
 		}
 		return true;
 	}
-	// 範囲攻撃
-	void CleanCombo() noexcept {
-		for (size_t ci1 = 0; ci1 < cleaner_status_.size() - 1; ++ci1) {
-			size_t position = cleaner_status_[ci1].position_now_;
-			for (size_t ci2 = ci1 + 1; ci2 < cleaner_status_.size(); ++ci2) {
-				if (position == cleaner_status_[ci2].position_now_ && cleaner_status_[ci1].move_now_ == cleaner_status_[ci2].move_now_) {
+	// 現状では拭ききれない場合はfalse
+	// (この先で範囲攻撃が起こりえないなら、鉢合わせを考慮しない場合と同じ判定になる)
+	bool CanMoveWithCombo(const size_t step) const noexcept {
+		const bool combo_ahead = board_->meet_ahead_[step] != 0;
+		if (!combo_ahead && !EnoughSteps()) return false;
+		return Covered() && CanDispose() && CanVisitExclusive(combo_ahead);
+	}
+	bool CanMoveNonCombo() const noexcept {
+		return EnoughSteps() && Covered() && CanDispose() && CanVisitExclusive(false);
+	}
+	// 範囲攻撃(stepは今動き終えた掃除人の歩数で、その歩数で鉢合わせできる組だけを調べる)
+	// 歩き終えて止まった掃除人どうしの鉢合わせは、止まった歩数の時点で範囲攻撃を済ませているので調べ直さない
+	void CleanCombo(const size_t step) noexcept {
+		BitBoard<Words> center;
+		const auto *meet_mask = &board_->meet_mask_[step * kMaxCleaners];
+		for (size_t ci1 = 0; ci1 + 1 < board_->cleaners_; ++ci1) {
+			if (meet_mask[ci1] == 0 || cleaner_.move_now_[ci1] != step) continue;
+			const auto position = cleaner_.position_now_[ci1];
+			for (uint32_t mask = meet_mask[ci1]; mask != 0; mask &= mask - 1) {
+				const size_t ci2 = LowestBit(mask);
+				if (position == cleaner_.position_now_[ci2] && cleaner_.move_now_[ci2] == step) {
 					// 範囲攻撃発動！
-					for (int i = -1; i <= 1; ++i) {
-						for (int j = -1; j <= 1; ++j) {
-							if (floor_[position + i + j * x_] == Floor::Dirty) floor_[position + i + j * x_] = Floor::Clean;
-						}
-					}
+					center.Set(position);
 				}
 			}
 		}
+		if (center.None()) return;
+		trail_.push_back({ TrailType::Hash, 0, hash_ });
+		// 発動地点を3x3に広げて、汚れた床だけを消す
+		// (左右にはみ出したビットは番兵の列に落ちるので、汚れた床を巻き込まない)
+		center |= center.ShiftUp(1) | center.ShiftDown(1);
+		center |= center.ShiftUp(X()) | center.ShiftDown(X());
+		stats_.Combo((center & dirty_).Count());
+		(center & dirty_).ForEach([this](const size_t position) {
+			trail_.push_back({ TrailType::Cell, position, Floor::Dirty });
+			need_[board_->cell_id_[position]] = 0;
+			hash_ ^= board_->ZobristFloor(Floor::Dirty, position);
+		});
+		dirty_.AndNot(center);
 	}
 	// 周囲にゴミ箱/リサイクル箱があった際に捨てる
-	size_t SurroundedBox(const Status &cleaner) const noexcept {
-		switch (cleaner.type_) {
+	uint8_t SurroundedBox(const size_t ci) const noexcept {
+		switch (board_->cleaner_type_[ci]) {
 		case Floor::Girl:
-			if (near_dustbox_[cleaner.position_now_] != 0) return 0;
+			if (board_->near_dustbox_[cleaner_.position_now_[ci]] != 0) return 0;
 			break;
 		case Floor::Robot:
-			if (near_recyclebox_[cleaner.position_now_] != 0) return 0;
+			if (board_->near_recyclebox_[cleaner_.position_now_[ci]] != 0) return 0;
 			break;
 		default:
 			break;
 		}
-		return cleaner.stock_;
+		return cleaner_.stock_[ci];
 	}
-	// 汚れやゴミなどがあった場合は掃除する
-	void CleanFloor(Floor &floor, Status &cleaner) noexcept{
-		switch (floor) {
-		case Floor::Dirty:
-			floor = Floor::Clean;
-			break;
-		case Floor::Clean:
-			break;
-		case Floor::Pool:
-			if (cleaner.type_ == Floor::Boy) floor = Floor::Clean;
+	// 汚れやゴミなどがあった場合は掃除する(掃除する前の床を記録に積む)
+	void CleanFloor(const size_t position, const size_t ci) noexcept{
+		if (dirty_.Test(position)) {
+			dirty_.Reset(position);
+			hash_ ^= board_->ZobristFloor(Floor::Dirty, position);
+			trail_.push_back({ TrailType::Cell, position, Floor::Dirty });
+			need_[board_->cell_id_[position]] = 0;
+			return;
+		}
+		switch (board_->cleaner_type_[ci]) {
+		case Floor::Boy:
+			if (pool_.Test(position)) {
+				pool_.Reset(position);
+				hash_ ^= board_->ZobristFloor(Floor::Pool, position);
+				trail_.push_back({ TrailType::Cell, position, Floor::Pool });
+				need_[board_->cell_id_[position]] = 0;
+				return;
+			}
 			break;
-		case Floor::Apple:
-			if (cleaner.type_ == Floor::Girl) {
-				++cleaner.stock_;
-				floor = Floor::Clean;
+		case Floor::Girl:
+			if (apple_.Test(position)) {
+				++cleaner_.stock_[ci];
+				apple_.Reset(position);
+				hash_ ^= board_->ZobristFloor(Floor::Apple, position);
+				trail_.push_back({ TrailType::Cell, position, Floor::Apple });
+				need_[board_->cell_id_[position]] = 0;
+				return;
 			}
 			break;
-		case Floor::Bottle:
-			if (cleaner.type_ == Floor::Robot) {
-				++cleaner.stock_;
-				floor = Floor::Clean;
+		case Floor::Robot:
+			if (bottle_.Test(position)) {
+				++cleaner_.stock_[ci];
+				bottle_.Reset(position);
+				hash_ ^= board_->ZobristFloor(Floor::Bottle, position);
+				trail_.push_back({ TrailType::Cell, position, Floor::Bottle });
+				need_[board_->cell_id_[position]] = 0;
+				return;
 			}
 			break;
 		default:
 			break;
 		}
 	}
-	// 指定地点へ移動させる
+	// 指定地点へ移動させる(書き換えた内容は記録に積む)
 	void MoveCleanerForward(const size_t ci, const size_t next_position) noexcept{
-		auto &it_c = cleaner_status_[ci];
-		auto &floor_ref = floor_[next_position];
-		it_c.position_old_ = it_c.position_now_;
-		it_c.position_now_ = next_position;
-		++it_c.move_now_;
-		it_c.stock_ = SurroundedBox(it_c);
-		CleanFloor(floor_ref, it_c);
-	}
-	// 手を戻す
-	void MoveCleanerBack(const size_t ci, const size_t next_position) noexcept{
-		auto &it_c = cleaner_status_[ci];
-		it_c.position_now_ = it_c.position_old_;
-		--it_c.move_now_;
+		trail_.push_back({ TrailType::Hash, 0, hash_ });
+		trail_.push_back({ TrailType::Step, ci, cleaner_.position_old_[ci] });
+		const auto old_stock = cleaner_.stock_[ci];
+		const size_t move_old = cleaner_.move_now_[ci];
+		UpdateReachCount(ci, cleaner_.position_now_[ci], next_position, move_old, false);
+		cleaner_.position_old_[ci] = cleaner_.position_now_[ci];
+		cleaner_.position_now_[ci] = static_cast<uint16_t>(next_position);
+		cleaner_.move_now_[ci] = static_cast<uint8_t>(move_old + 1);
+		cleaner_.stock_[ci] = SurroundedBox(ci);
+		auto &log = move_log_[board_->move_log_offset_[ci] + move_old / kMovesPerWord];
+		const size_t shift = 2 * (move_old % kMovesPerWord);
+		log = (log & ~(uint64_t(3) << shift)) | (uint64_t(StepDirection(cleaner_.position_old_[ci], next_position, X())) << shift);
+		CleanFloor(next_position, ci);
+		if (cleaner_.stock_[ci] != old_stock) trail_.push_back({ TrailType::Stock, ci, old_stock });
+	}
+	// 掃除人ciが歩き終える歩数をendまで縮める(残り歩数で届かなくなったマスの人数も減らす)
+	void ShortenWalk(const size_t ci, const size_t end) noexcept {
+		trail_.push_back({ TrailType::End, ci, cleaner_.move_end_[ci] });
+		const auto *row = CurrentReachRow(ci, row_buffer_.data());
+		ReachDelta(&reach_count_[TypeIndex(board_->cleaner_type_[ci]) * board_->cells_stride_], row, row,
+			RestCost(cleaner_.move_end_[ci] - cleaner_.move_now_[ci]), RestCost(end - cleaner_.move_now_[ci]), false, board_->cells_stride_);
+		cleaner_.move_end_[ci] = static_cast<uint8_t>(end);
+	}
+	// 記録がmarkの長さになるまで、積んだ逆順に手を戻す
+	void Undo(const size_t mark) noexcept{
+		while (trail_.size() > mark) {
+			const auto &trail = trail_.back();
+			switch (trail.type_) {
+			case TrailType::Cell:
+				SetFloor(trail.index_, static_cast<Floor>(trail.value_));
+				break;
+			case TrailType::Step: {
+				const size_t ci = trail.index_;
+				UpdateReachCount(ci, cleaner_.position_old_[ci], cleaner_.position_now_[ci], cleaner_.move_now_[ci] - 1, true);
+				cleaner_.position_now_[ci] = cleaner_.position_old_[ci];
+				cleaner_.position_old_[ci] = static_cast<uint16_t>(trail.value_);
+				--cleaner_.move_now_[ci];
+				break;
+			}
+			case TrailType::Stock:
+				cleaner_.stock_[trail.index_] = static_cast<uint8_t>(trail.value_);
+				break;
+			case TrailType::Hash:
+				hash_ = trail.value_;
+				break;
+			case TrailType::End: {
+				const size_t ci = trail.index_;
+				const auto *row = CurrentReachRow(ci, row_buffer_.data());
+				ReachDelta(&reach_count_[TypeIndex(board_->cleaner_type_[ci]) * board_->cells_stride_], row, row,
+					RestCost(trail.value_ - cleaner_.move_now_[ci]), RestCost(cleaner_.move_end_[ci] - cleaner_.move_now_[ci]), true, board_->cells_stride_);
+				cleaner_.move_end_[ci] = static_cast<uint8_t>(trail.value_);
+				break;
+			}
+			}
+			trail_.pop_back();
+		}
+	}
+	// 解けた盤面を問題ごとの解答欄に書き込む
+	void StoreAnswer() const {
+		std::lock_guard<std::mutex> lock(context_->mutex_);
+		if (!context_->answer_) context_->answer_ = std::make_unique<Query>(*this);
+		if (context_->cancel_ != nullptr) context_->cancel_->Cancel();
+	}
+	// 解を全部数える場合は、見つけた解を数えて探索を続ける(続けるならtrue、数えない場合と上限に達した場合はfalse)
+	// 最初に見つけた解は解答欄に入れ、書き出し先があれば1行ずつU/D/L/Rの列で書き出す
+	bool CountSolution() {
+		if (!context_->count_flg_) return false;
+		++solutions_;
+		if (context_->solution_limit_ == 0 && context_->solution_out_ == nullptr) {
+			// 数えるだけなら手元で数えておき、統計と一緒に足し込む
+			if (solutions_ == 1) StoreAnswer();
+			return true;
+		}
+		++solutions_flushed_;
+		const uint64_t index = context_->solutions_++;
+		const uint64_t limit = context_->solution_limit_;
+		if (limit != 0 && index >= limit) return false;
+		if (index == 0) StoreAnswer();
+		if (context_->solution_out_ != nullptr) {
+			const string codes = MoveCodes();
+			std::lock_guard<std::mutex> lock(context_->mutex_);
+			*context_->solution_out_ << codes << '\n';
+		}
+		return limit == 0 || index + 1 < limit;
+	}
+	// 分担探索で、この局面までの移動の列を手順として書き出す(この先は探索しないのでfalseを返す)
+	// 書き出しすぎたら打ち切る(呼び出し側で、浅い深さの手順を使う)
+	bool RecordPrefix() {
+		const string codes = MoveCodes();
+		std::lock_guard<std::mutex> lock(context_->mutex_);
+		context_->prefixes_.push_back(codes);
+		if (context_->prefixes_.size() >= kMaxPrefixes) context_->stop_flg_ = true;
+		return false;
+	}
+	// 最適化モードで小さくする量(今の局面で全員が歩き終えたとする)
+	size_t Cost() const noexcept {
+		size_t total = 0, makespan = 0;
+		for (size_t ci = 0; ci < board_->cleaners_; ++ci) {
+			total += cleaner_.move_now_[ci];
+			makespan = std::max<size_t>(makespan, cleaner_.move_now_[ci]);
+		}
+		return objective_ == Objective::Makespan ? makespan : total;
+	}
+	// 最適化モードで、解けた盤面が最良の解より良ければ解答欄を置き換える
+	void ImproveAnswer() {
+		const size_t cost = Cost();
+		if (cost >= context_->best_cost_.load(std::memory_order_relaxed)) return;
+		std::lock_guard<std::mutex> lock(context_->mutex_);
+		if (cost >= context_->best_cost_) return;
+		context_->best_cost_ = cost;
+		context_->answer_ = std::make_unique<Query>(*this);
+	}
+	// 最適化モードで、深さdepthの開始時点の局面を調べる(この先を探索しなくてよければfalse)
+	// 解けていれば解答欄と比べて記録し、そうでなければ最良の解より良くなる範囲まで各掃除人の歩き終える歩数を詰める
+	// 詰めた歩数はreach_count_やEnoughStepsなどにそのまま効くので、min_cost_による枝刈りも最良の解が良くなるほど厳しくなる
+	bool TightenWalks(const size_t depth) noexcept {
+		if (Sweeped()) {
+			ImproveAnswer();
+			return false;
+		}
+		const size_t best = context_->best_cost_.load(std::memory_order_relaxed);
+		if (best == SIZE_MAX) return true;
+		// まだ解けていないので、少なくとも誰かがもう1歩歩く
+		const size_t cost = Cost();
+		if (cost + 1 >= best) return false;
+		for (size_t ci = 0; ci < board_->cleaners_; ++ci) {
+			const size_t end = (objective_ == Objective::Makespan ? best - 1 : cleaner_.move_now_[ci] + (best - 1 - cost));
+			if (end < cleaner_.move_end_[ci]) ShortenWalk(ci, end);
+		}
+		// 範囲攻撃が起こりえなければ、1歩で掃除できるのは1マスだけ
+		if (objective_ == Objective::Total && !(combo_flg_ && board_->meet_ahead_[depth + 1] != 0) && cost + MustClean().Count() >= best) return false;
+		return true;
+	}
+	// 解けたか時間切れ・取り消しなら探索を打ち切る(時計と取り消しトークンはkClockIntervalノードごとにしか見ない)
+	// 進捗を表示できるように、そのついでに統計も足し込んでおく
+	bool Stopped() noexcept {
+		if ((++nodes_ & (kClockInterval - 1)) == 0) {
+			FlushStats();
+			if (context_->Expired() || context_->Cancelled()) context_->stop_flg_ = true;
+		}
+		return context_->stop_flg_.load(std::memory_order_relaxed);
+	}
+	// 次に移動可能な位置を列挙する(すぐ前に行った場所にバックするのは禁じられている)
+	size_t NextPositions(const size_t ci, std::array<size_t, kDirections> &next_position) const noexcept {
+		const size_t position = cleaner_.position_now_[ci];
+		const size_t direction = board_->next_direction_[position];
+		size_t count = 0;
+		for (size_t d = 0; d < kDirections; ++d) {
+			const size_t next = StepPosition(position, d, X());
+			if (((direction >> d) & 1) == 0 || next == cleaner_.position_old_[ci]) continue;
+			next_position[count++] = next;
+		}
+		return count;
+	}
+	// 深さdepthの開始時点で、種類・最大歩数・位置・過去の位置・所持数がすべて同じ掃除人の組を探す
+	// そうした2人は以降の移動を丸ごと入れ替えても同じ解になるので、片方の順序だけ調べればよい
+	void FindTwins(const size_t depth) noexcept {
+		auto *twin = &twin_[depth * kMaxCleaners];
+		for (size_t cj = 0; cj < board_->cleaners_; ++cj) {
+			twin[cj] = 0;
+			if (cleaner_.move_now_[cj] != depth || cleaner_.move_now_[cj] == cleaner_.move_end_[cj]) continue;
+			for (size_t ci = cj; ci-- > 0;) {
+				if (board_->cleaner_class_[ci] == board_->cleaner_class_[cj]
+					&& cleaner_.move_now_[ci] == cleaner_.move_now_[cj]
+					&& cleaner_.move_end_[ci] == cleaner_.move_end_[cj]
+					&& cleaner_.position_now_[ci] == cleaner_.position_now_[cj]
+					&& cleaner_.position_old_[ci] == cleaner_.position_old_[cj]
+					&& cleaner_.stock_[ci] == cleaner_.stock_[cj]) {
+					twin[cj] = static_cast<uint8_t>(ci + 1);
+					break;
+				}
+			}
+		}
+	}
+	// 相方と区別できない掃除人は、相方がこの深さで進んだ位置より小さい位置には進まない
+	// (同じマスから出発するので、移動先の位置の大小は上・左・右・下の順と一致する)
+	size_t BreakSymmetry(const size_t depth, const size_t ci, std::array<size_t, kDirections> &next_position, const size_t count) noexcept {
+		// 解を数える場合は、入れ替えただけの解も別々に数えるので省かない
+		const size_t twin = twin_[depth * kMaxCleaners + ci];
+		if (twin == 0 || context_->count_flg_) return count;
+		// 最適化モードで相方がこの深さで歩き終えたなら、自分も歩き終える(歩き終える手は、どの移動先よりも後に並べたとみなす)
+		if (cleaner_.move_now_[twin - 1] == depth) {
+			stats_.SymmetryCut(count);
+			return 0;
+		}
+		// 相方は番号が小さいので、この深さの分はもう進んでいる
+		const size_t bound = cleaner_.position_now_[twin - 1];
+		size_t kept = 0;
+		for (size_t di = 0; di < count; ++di) {
+			if (next_position[di] >= bound) next_position[kept++] = next_position[di];
+		}
+		stats_.SymmetryCut(count - kept);
+		return kept;
+	}
+	// 掃除人の種類ごとの、掃除できるマスのneed_の値
+	static uint8_t NeedMask(const Floor type) noexcept {
+		return kNeedAny | (type == Floor::Boy ? kNeedBoy : type == Floor::Girl ? kNeedGirl : kNeedRobot);
+	}
+	// 位置positionから、maskの掃除人が掃除できる最寄りのマスまでの最小移動歩数
+	// (大きな盤面では行を作らず、掃除できるマスごとに下界を求める)
+	uint32_t NearestCost(const size_t position, const uint8_t mask) const noexcept {
+		uint8_t cost = kFarCost;
+		if (board_->landmark_flg_) {
+			const size_t source = board_->cell_id_[position];
+			for (size_t i = 0; i < board_->cells_stride_; ++i) {
+				if ((need_[i] & mask) != 0) cost = std::min(cost, board_->CellCost(source, i));
+			}
+			return cost;
+		}
+		const auto *min_cost = board_->MinCostRow(position);
+		for (size_t i = 0; i < board_->cells_stride_; ++i) {
+			if ((need_[i] & mask) != 0) cost = std::min(cost, min_cost[i]);
+		}
+		return cost;
+	}
+	// 掃除人ciが位置nextへ進む手の優先度(小さいほど先に試す)
+	uint32_t MoveScore(const size_t ci, const size_t next) const noexcept {
+		const size_t cell = board_->cell_id_[next];
+		const auto type = board_->cleaner_type_[ci];
+		const uint8_t mask = NeedMask(type);
+		switch (order_) {
+		case MoveOrder::Clean:
+			return (need_[cell] & mask) != 0 ? 0 : 1;
+		case MoveOrder::Box:
+			if (cleaner_.stock_[ci] != 0) return (type == Floor::Girl ? board_->dustbox_cost_ : board_->recyclebox_cost_)[cell];
+			return NearestCost(next, mask);
+		case MoveOrder::Nearest:
+			return NearestCost(next, mask);
+		case MoveOrder::Constrained: {
+			// 掃除しないマスへ進む手は最後に回す
+			const uint8_t need = need_[cell] & mask;
+			if (need == 0) return UINT32_MAX;
+			return Reachers(cell, need);
+		}
+		default:
+			return 0;
+		}
+	}
+	// 移動先をorder_の順に並べ替える(同点なら上・左・右・下の順のまま)
+	void OrderMoves(const size_t ci, std::array<size_t, kDirections> &next_position, const size_t count) const noexcept {
+		if (order_ == MoveOrder::Fixed || count < 2) return;
+		std::array<uint32_t, kDirections> score;
+		for (size_t di = 0; di < count; ++di) score[di] = MoveScore(ci, next_position[di]);
+		// 高々4要素なので挿入ソートで足りる
+		for (size_t di = 1; di < count; ++di) {
+			for (size_t dj = di; dj > 0 && score[dj] < score[dj - 1]; --dj) {
+				std::swap(score[dj], score[dj - 1]);
+				std::swap(next_position[dj], next_position[dj - 1]);
+			}
+		}
+	}
+	// 置換表に解けないと記録されているか調べる
+	bool LookupUnsolvable(const size_t depth, const uint64_t key) noexcept {
+		if (table_ == nullptr || depth + kTableMinRest > board_->max_depth_) return false;
+		if (table_->Contains(key)) {
+			++table_hits_;
+			return true;
+		}
+		++table_misses_;
+		return false;
+	}
+	// 部分木を調べ尽くしても解けなかった局面を置換表に記録する
+	// (途中で他のワーカーに分けた場合や、解けて打ち切られた場合は調べ尽くしていないので記録しない。解を数えていて部分木に解があった場合も記録しない)
+	void StoreUnsolvable(const size_t depth, const uint64_t key, const size_t splits, const uint64_t solutions) noexcept {
+		if (table_ == nullptr || depth + kTableMinRest > board_->max_depth_ || splits_ != splits || solutions_ != solutions || context_->stop_flg_) return;
+		table_->Insert(key);
+	}
+	// タスクごとに数えた統計を共有の置換表・探索の状態に足し込む
+	void FlushStats() noexcept {
+		if (table_ != nullptr) table_->AddStats(table_hits_, table_misses_);
+		context_->nodes_ += nodes_;
+		context_->prune_checks_ += prune_checks_;
+		context_->prune_hits_ += prune_hits_;
+		context_->solutions_ += solutions_ - solutions_flushed_;
+		solutions_flushed_ = solutions_;
+		table_hits_ = table_misses_ = nodes_ = prune_checks_ = prune_hits_ = 0;
+		if (kStatsEnabled) {
+			std::lock_guard<std::mutex> lock(context_->mutex_);
+			context_->stats_.Merge(stats_);
+			stats_.Clear();
+		}
+	}
+	// 探索をタスクとして投入する(この問題の最後のタスクが終わったらon_finish_を呼ぶ)
+	template<typename Function>
+	static void SpawnSearch(std::shared_ptr<Query> query, Function search) {
+		auto *context = query->context_;
+		++context->pending_;
+		g_pool->Spawn([query, search, context] {
+			if (search(*query)) query->StoreAnswer();
+			query->FlushStats();
+			if (--context->pending_ == 0 && context->on_finish_) {
+				// on_finish_の中で問題ごと捨てられてもよいよう、写しを呼ぶ
+				const auto on_finish = context->on_finish_;
+				on_finish();
+			}
+		});
+	}
+	// 2番目以降の移動先を別タスクとして、暇なワーカーに盗ませる
+	template<typename Function>
+	size_t SplitBranches(const size_t ci, const std::array<size_t, kDirections> &next_position, const size_t count, Function search) {
+		++splits_;
+		stats_.Split(count - 1);
+		for (size_t di = 1; di < count; ++di) {
+			auto branch = std::make_shared<Query>(*this);
+			branch->table_hits_ = branch->table_misses_ = branch->nodes_ = branch->prune_checks_ = branch->prune_hits_ = 0;
+			branch->solutions_flushed_ = branch->solutions_;
+			branch->stats_.Clear();
+			// 分けた先はここより前には戻らないので、記録は持ち越さない
+			branch->trail_.clear();
+			branch->MoveCleanerForward(ci, next_position[di]);
+			SpawnSearch(branch, search);
+		}
+		return 1;
 	}
 	// 探索ルーチン
 	bool MoveWithCombo(const size_t depth, const size_t index) {
-		if (g_solved_flg) return false;
+		if (Stopped()) return false;
+		stats_.Node(depth);
+		if (index == 0) {
+			if (depth == context_->prefix_depth_) return RecordPrefix();
+			if (objective_ != Objective::None && !TightenWalks(depth)) return false;
+			FindTwins(depth);
+		}
 		// 全員を1歩だけ進める＝depthと等しい歩数の掃除人がいない
-		for (size_t ci = index; ci < cleaner_status_.size(); ++ci) {
-			auto &it_c = cleaner_status_[ci];
+		for (size_t ci = index; ci < board_->cleaners_; ++ci) {
 			// 歩を進めるべきではない掃除人は飛ばす
-			if (it_c.move_now_ != depth) continue;
-			if (it_c.move_now_ == it_c.move_max_) continue;
-			const auto &position = it_c.position_now_;
+			if (cleaner_.move_now_[ci] != depth) continue;
+			if (cleaner_.move_now_[ci] == cleaner_.move_end_[ci]) continue;
 			// 上下左右の動きについて議論する
-			if (g_threads < max_threads_) {
-				vector<size_t> next_position;
-				next_position.reserve(kDirections);
-				for (const auto &next : next_position_[position]) {
-					// すぐ前に行った場所にバックするのは禁じられている
-					if (next == it_c.position_old_) continue;
-					// 移動先に追加
-					next_position.push_back(next);
-				}
-				vector<std::future<bool>> result(next_position.size());
-				std::deque<bool> result_get(next_position.size());
-				vector<Query> query_back(next_position.size(), *this);
-				g_mutex.lock(); g_threads += next_position.size() - 1; g_mutex.unlock();
-				for (size_t di = 0; di < next_position.size(); ++di) {
-					result[di] = std::async(std::launch::async, [this, &it_c, next_position, ci, di, &query_back, depth] {
-						const auto old_position = it_c.position_old_;
-						const auto old_stock = it_c.stock_;
-						const auto old_floor = floor_[next_position[di]];
-						query_back[di].MoveCleanerForward(ci, next_position[di]);
-						// 移動処理
-						if (!query_back[di].MoveWithCombo(depth, ci + 1)) return false;
-						query_back[di].cleaner_move_[ci].push_front(next_position[di]);
-						return true;
-					});
-				}
-				for (size_t di = 0; di < next_position.size(); ++di) {
-					result_get[di] = result[di].get();
-				}
-				g_mutex.lock(); g_threads -= next_position.size() - 1; g_mutex.unlock();
-				for (size_t di = 0; di < next_position.size(); ++di) {
-					if (result_get[di]) {
-						*this = std::move(query_back[di]);
-						return true;
-					}
-				}
-				return false;
+			std::array<size_t, kDirections> next_position;
+			size_t count = BreakSymmetry(depth, ci, next_position, NextPositions(ci, next_position));
+			OrderMoves(ci, next_position, count);
+			if (count >= 2 && g_pool->Hungry() && context_->prefix_depth_ == SIZE_MAX) count = SplitBranches(ci, next_position, count, [depth, ci](Query &branch) {
+				return branch.MoveWithCombo(depth, ci + 1);
+			});
+			for (size_t di = 0; di < count; ++di) {
+				// 移動を行う
+				const size_t mark = trail_.size();
+				MoveCleanerForward(ci, next_position[di]);
+				// 移動処理
+				if (MoveWithCombo(depth, ci + 1)) return true;
+				// 元に戻す
+				Undo(mark);
 			}
-			else {
-				for (const auto &next_position : next_position_[position]) {
-					// すぐ前に行った場所にバックするのは禁じられている
-					if (next_position == it_c.position_old_) continue;
-					// 移動を行う
-					auto &floor_ref = floor_[next_position];
-					const auto old_position = it_c.position_old_;
-					const auto old_floor = floor_ref;
-					const auto old_stock = it_c.stock_;
-					MoveCleanerForward(ci, next_position);
-					// 移動処理
-					if (MoveWithCombo(depth, ci + 1)) {
-						cleaner_move_[ci].push_front(next_position);
-						return true;
-					}
-					// 元に戻す
-					MoveCleanerBack(ci, next_position);
-					it_c.position_old_ = old_position;
-					floor_ref = old_floor;
-					it_c.stock_ = old_stock;
-				}
+			// 最適化モードでは、ここで歩き終える手も試す(リンゴ・ビンを持っていれば捨てられないので試さない)
+			if (objective_ != Objective::None && cleaner_.stock_[ci] == 0) {
+				const size_t mark = trail_.size();
+				ShortenWalk(ci, depth);
+				if (MoveWithCombo(depth, ci + 1)) return true;
+				Undo(mark);
 			}
 			return false;
 		}
 		// 再帰深さが最大の時は、解けているかどうかをチェックする
-		if (depth >= max_depth_) {
+		if (depth >= board_->max_depth_) {
 			// 盤面が埋まっているかをチェックする
+			stats_.SweepedCheck();
 			if (Sweeped()) {
-				g_mutex.lock();
-				g_solved_flg = true;
-				g_mutex.unlock();
+				if (CountSolution()) return false;
+				context_->stop_flg_ = true;
 				return true;
 			}
 			else {
@@ -503,92 +2190,72 @@ public:
 			}
 		}
 		// min_cost_による枝刈りを行う
-		if (!CanMoveWithCombo()) return false;
+		++prune_checks_;
+		if (!CanMoveWithCombo(depth + 1)) {
+			++prune_hits_;
+			stats_.Prune(depth, true);
+			return false;
+		}
+		stats_.Prune(depth, false);
+		// 置換表に解けないと記録されている局面なら打ち切る
+		const uint64_t key = TableKey(depth);
+		if (LookupUnsolvable(depth, key)) return false;
 		// 同タイミングで複数人がコラボすることによる範囲攻撃を考慮する
-		vector<Floor> floor_back = floor_;
-		CleanCombo();
-		bool flg = MoveWithCombo(depth + 1, 0);
-		floor_ = floor_back;
-		return flg;
+		const size_t mark = trail_.size();
+		const size_t splits = splits_;
+		const uint64_t solutions = solutions_;
+		if (board_->meet_ahead_[depth + 1] != 0) CleanCombo(depth + 1);
+		// 解けた場合は、解けた盤面を解答欄に入れるので戻さない
+		if (MoveWithCombo(depth + 1, 0)) return true;
+		Undo(mark);
+		StoreUnsolvable(depth, key, splits, solutions);
+		return false;
 	}
 	bool MoveNonCombo(const size_t depth, const size_t index){
-		if (g_solved_flg) return false;
+		if (Stopped()) return false;
+		stats_.Node(depth);
+		if (index == 0) {
+			if (depth == context_->prefix_depth_) return RecordPrefix();
+			if (objective_ != Objective::None && !TightenWalks(depth)) return false;
+			FindTwins(depth);
+		}
 		// 全員を1歩だけ進める＝depthと等しい歩数の掃除人がいない
-		for(size_t ci = index; ci < cleaner_status_.size(); ++ci){
-			auto &it_c = cleaner_status_[ci];
+		for(size_t ci = index; ci < board_->cleaners_; ++ci){
 			// 歩を進めるべきではない掃除人は飛ばす
-			if (it_c.move_now_ != depth) continue;
-			if (it_c.move_now_ == it_c.move_max_) continue;
-			const auto &position = it_c.position_now_;
+			if (cleaner_.move_now_[ci] != depth) continue;
+			if (cleaner_.move_now_[ci] == cleaner_.move_end_[ci]) continue;
 			// 上下左右の動きについて議論する
-			if (g_threads < max_threads_) {
-				vector<size_t> next_position;
-				next_position.reserve(kDirections);
-				for (const auto &next : next_position_[position]) {
-					// すぐ前に行った場所にバックするのは禁じられている
-					if (next == it_c.position_old_) continue;
-					// 移動先に追加
-					next_position.push_back(next);
-				}
-				vector<std::future<bool>> result(next_position.size());
-				std::deque<bool> result_get(next_position.size());
-				vector<Query> query_back(next_position.size(), *this);
-				g_mutex.lock(); g_threads += next_position.size() - 1; g_mutex.unlock();
-				for (size_t di = 0; di < next_position.size(); ++di) {
-					result[di] = std::async(std::launch::async, [this, &it_c, next_position, ci, di, &query_back, depth] {
-						const auto old_position = it_c.position_old_;
-						const auto old_stock = it_c.stock_;
-						const auto old_floor = floor_[next_position[di]];
-						query_back[di].MoveCleanerForward(ci, next_position[di]);
-						// 移動処理
-						if (!query_back[di].MoveNonCombo(depth, ci + 1)) return false;
-						query_back[di].cleaner_move_[ci].push_front(next_position[di]);
-						return true;
-					});
-				}
-				for (size_t di = 0; di < next_position.size(); ++di) {
-					result_get[di] = result[di].get();
-				}
-				g_mutex.lock(); g_threads -= next_position.size() - 1; g_mutex.unlock();
-				for (size_t di = 0; di < next_position.size(); ++di) {
-					if (result_get[di]) {
-						*this = std::move(query_back[di]);
-						return true;
-					}
-				}
-				return false;
+			std::array<size_t, kDirections> next_position;
+			size_t count = BreakSymmetry(depth, ci, next_position, NextPositions(ci, next_position));
+			OrderMoves(ci, next_position, count);
+			if (count >= 2 && g_pool->Hungry() && context_->prefix_depth_ == SIZE_MAX) count = SplitBranches(ci, next_position, count, [depth, ci](Query &branch) {
+				return branch.MoveNonCombo(depth, ci + 1);
+			});
+			for (size_t di = 0; di < count; ++di) {
+				// 移動を行う
+				const size_t mark = trail_.size();
+				MoveCleanerForward(ci, next_position[di]);
+				// 移動処理
+				if (MoveNonCombo(depth, ci + 1)) return true;
+				// 元に戻す
+				Undo(mark);
 			}
-			else {
-				for (const auto &next_position : next_position_[position]) {
-					// すぐ前に行った場所にバックするのは禁じられている
-					if (next_position == it_c.position_old_) continue;
-					// 移動を行う
-					auto &floor_ref = floor_[next_position];
-					const auto old_position = it_c.position_old_;
-					const auto old_floor = floor_ref;
-					const auto old_stock = it_c.stock_;
-					MoveCleanerForward(ci, next_position);
-					// 移動処理
-					if (MoveNonCombo(depth, ci + 1)) {
-						cleaner_move_[ci].push_front(next_position);
-						return true;
-					}
-					// 元に戻す
-					MoveCleanerBack(ci, next_position);
-					it_c.position_old_ = old_position;
-					floor_ref = old_floor;
-					it_c.stock_ = old_stock;
-				}
+			// 最適化モードでは、ここで歩き終える手も試す(リンゴ・ビンを持っていれば捨てられないので試さない)
+			if (objective_ != Objective::None && cleaner_.stock_[ci] == 0) {
+				const size_t mark = trail_.size();
+				ShortenWalk(ci, depth);
+				if (MoveNonCombo(depth, ci + 1)) return true;
+				Undo(mark);
 			}
 			return false;
 		}
 		// 再帰深さが最大の時は、解けているかどうかをチェックする
-		if (depth >= max_depth_) {
+		if (depth >= board_->max_depth_) {
 			// 盤面が埋まっているかをチェックする
+			stats_.SweepedCheck();
 			if (Sweeped()) {
-				g_mutex.lock();
-				g_solved_flg = true;
-				g_mutex.unlock();
+				if (CountSolution()) return false;
+				context_->stop_flg_ = true;
 				return true;
 			}
 			else {
@@ -596,13 +2263,368 @@ public:
 			}
 		}
 		// min_cost_による枝刈りを行う
-		if (!CanMoveNonCombo()) return false;
-		return MoveNonCombo(depth + 1, 0);
+		++prune_checks_;
+		if (!CanMoveNonCombo()) {
+			++prune_hits_;
+			stats_.Prune(depth, true);
+			return false;
+		}
+		stats_.Prune(depth, false);
+		// 置換表に解けないと記録されている局面なら打ち切る
+		const uint64_t key = TableKey(depth);
+		if (LookupUnsolvable(depth, key)) return false;
+		const size_t splits = splits_;
+		const uint64_t solutions = solutions_;
+		bool flg = MoveNonCombo(depth + 1, 0);
+		if (!flg) StoreUnsolvable(depth, key, splits, solutions);
+		return flg;
+	}
+	// 被覆エンジン(鉢合わせを考慮しない場合専用)
+	// 鉢合わせを考慮しなければ、掃除人どうしは「どのマスを通るか」でしか影響し合わない
+	// そこで各掃除人の経路を別々に列挙しておき、掃除できるマスの和集合が全マスを覆う組み合わせを探す
+	// positionから残りrest歩で歩ききる経路を列挙する(経路が多すぎるか打ち切られた場合はfalse)
+	bool WalkPaths(PathWalk &walk, const size_t position, const size_t position_old, const size_t rest, const size_t stock,
+		const BitBoard<Words> &cover, const uint64_t route, const size_t step) {
+		if (Stopped()) return false;
+		if (rest == 0) {
+			if (stock == 0) walk.paths_.emplace_back(cover, route);
+			return walk.paths_.size() <= kCoverMaxPaths;
+		}
+		const size_t direction = board_->next_direction_[position];
+		for (size_t d = 0; d < kDirections; ++d) {
+			const size_t next = StepPosition(position, d, X());
+			if (((direction >> d) & 1) == 0 || next == position_old) continue;
+			// 捨ててから拾う(MoveCleanerForwardと同じ順)
+			size_t next_stock = (walk.near_box_ != nullptr && (*walk.near_box_)[next] != 0) ? 0 : stock;
+			auto next_cover = cover;
+			if (walk.cleanable_.Test(next) && !cover.Test(next)) {
+				next_cover.Set(next);
+				if (walk.items_.Test(next)) ++next_stock;
+			}
+			// 持っているものを捨てに行けない経路は、その先を列挙しない
+			if (next_stock != 0 && DisposeCost(walk.type_, board_->cell_id_[next]) > rest - 1) continue;
+			if (!WalkPaths(walk, next, position, rest - 1, next_stock, next_cover, route | (uint64_t(d) << (2 * step)), step + 1)) return false;
+		}
+		return true;
+	}
+	// 掃除人ciが今の状態から最大歩数まで歩く経路を列挙して、掃除できるマスが同じ経路は1つにまとめる
+	// 拾ったものを捨てきれない経路は除く(他の掃除人が先に拾えば成り立つ経路もあるが、そうした解は深さ優先探索に任せる)
+	bool EnumeratePaths(const size_t ci, vector<BitBoard<Words>> &covers, vector<uint64_t> &routes) {
+		PathWalk walk;
+		walk.type_ = board_->cleaner_type_[ci];
+		walk.near_box_ = nullptr;
+		switch (walk.type_) {
+		case Floor::Boy:
+			walk.cleanable_ = dirty_ | pool_;
+			break;
+		case Floor::Girl:
+			walk.items_ = apple_;
+			walk.near_box_ = &board_->near_dustbox_;
+			break;
+		default:
+			walk.items_ = bottle_;
+			walk.near_box_ = &board_->near_recyclebox_;
+			break;
+		}
+		if (walk.near_box_ != nullptr) walk.cleanable_ = dirty_ | walk.items_;
+		if (!WalkPaths(walk, cleaner_.position_now_[ci], cleaner_.position_old_[ci], board_->move_max_[ci] - cleaner_.move_now_[ci],
+			cleaner_.stock_[ci], BitBoard<Words>(), 0, 0)) return false;
+		// 掃除できるマスが同じ経路は1つにまとめる
+		std::sort(walk.paths_.begin(), walk.paths_.end(), [](const auto &lhs, const auto &rhs) { return lhs.first < rhs.first; });
+		walk.paths_.erase(std::unique(walk.paths_.begin(), walk.paths_.end(), [](const auto &lhs, const auto &rhs) { return lhs.first == rhs.first; }), walk.paths_.end());
+		// 掃除できるマスが他の経路に含まれる経路は要らない(多く掃除できる経路から順に見て、既に残した経路の部分集合なら捨てる)
+		const bool dominance_flg = walk.paths_.size() <= kCoverDominanceMax;
+		if (dominance_flg) {
+			std::stable_sort(walk.paths_.begin(), walk.paths_.end(), [](const auto &lhs, const auto &rhs) { return lhs.first.Count() > rhs.first.Count(); });
+		}
+		for (const auto &path : walk.paths_) {
+			const bool dominated = dominance_flg && std::any_of(covers.begin(), covers.end(), [&path](const BitBoard<Words> &other) {
+				auto rest = path.first;
+				return rest.AndNot(other).None();
+			});
+			if (dominated) continue;
+			covers.push_back(path.first);
+			routes.push_back(path.second);
+		}
+		return true;
+	}
+	// まだ覆われていないマスのうち、掃除できる経路が最も少ないマス(通し番号)
+	size_t FewestHolders(const CoverTable &table, const BitBoard<Words> &lacking) const noexcept {
+		size_t target = 0, fewest = SIZE_MAX;
+		lacking.ForEach([this, &table, &target, &fewest](const size_t position) {
+			const size_t cell = board_->cell_id_[position];
+			if (table.holders_[cell] < fewest) {
+				target = cell;
+				fewest = table.holders_[cell];
+			}
+		});
+		return target;
+	}
+	// 経路が決まっていない掃除人(unassignedのビット)の経路を選んで、coveredと合わせて全マスを覆えるか調べる
+	// まだ覆われていないマスのうち掃除できる経路が最も少ないマスを選び、そこを通る経路を順に試す
+	bool JoinPaths(const CoverTable &table, const uint32_t unassigned, const BitBoard<Words> &covered, std::array<uint32_t, kMaxCleaners> &choice) {
+		if (Stopped()) return false;
+		auto lacking = table.required_;
+		lacking.AndNot(covered);
+		if (lacking.None()) {
+			// 残りの掃除人はどの経路でもよい
+			for (size_t ci = 0; ci < board_->cleaners_; ++ci) {
+				if (((unassigned >> ci) & 1) != 0) choice[ci] = 0;
+			}
+			return ReplayPaths(table, choice);
+		}
+		// 残りの掃除人がどう歩いても覆えないマスが残るなら打ち切る
+		BitBoard<Words> reach;
+		for (size_t ci = 0; ci < board_->cleaners_; ++ci) {
+			if (((unassigned >> ci) & 1) != 0) reach |= table.reach_[ci];
+		}
+		auto unreachable = lacking;
+		if (unreachable.AndNot(reach).Any()) return false;
+		const size_t target = FewestHolders(table, lacking);
+		vector<BitBoard<Words>> tried;
+		for (size_t ci = 0; ci < board_->cleaners_; ++ci) {
+			if (((unassigned >> ci) & 1) == 0) continue;
+			// 同じ掃除人で、既に試して駄目だった経路が覆うマス(まだ覆われていないものに限る)を全部覆える経路はない
+			// (その経路で覆えなかったのだから、それより少ないマスしか覆えない経路でも覆えない)
+			tried.clear();
+			for (const auto pi : table.holder_[ci][target]) {
+				const auto gain = table.cover_[ci][pi] & lacking;
+				const bool dominated = std::any_of(tried.begin(), tried.end(), [&gain](const BitBoard<Words> &other) {
+					auto rest = gain;
+					return rest.AndNot(other).None();
+				});
+				if (dominated) continue;
+				choice[ci] = pi;
+				if (JoinPaths(table, unassigned & ~(uint32_t(1) << ci), covered | table.cover_[ci][pi], choice)) return true;
+				tried.push_back(gain);
+			}
+		}
+		return false;
+	}
+	// 選んだ経路どおりに全員を動かして、解けているか確かめる(被覆エンジンは探索の根からしか使わない)
+	bool ReplayPaths(const CoverTable &table, const std::array<uint32_t, kMaxCleaners> &choice) {
+		const size_t mark = trail_.size();
+		for (size_t depth = 0; depth < board_->max_depth_; ++depth) {
+			for (size_t ci = 0; ci < board_->cleaners_; ++ci) {
+				const size_t move_now = cleaner_.move_now_[ci];
+				if (move_now != depth || move_now == board_->move_max_[ci]) continue;
+				const size_t d = (table.route_[ci][choice[ci]] >> (2 * move_now)) & 3;
+				MoveCleanerForward(ci, StepPosition(cleaner_.position_now_[ci], d, X()));
+			}
+		}
+		if (Sweeped()) {
+			context_->stop_flg_ = true;
+			return true;
+		}
+		Undo(mark);
+		return false;
+	}
+	// 最初に埋めるマスの候補のbegin～end番目について組み合わせを探す
+	// 最後に終わったタスクは、組み合わせが見つからなければ深さ優先探索に切り替える
+	bool JoinChunk(CoverTable &table, const size_t begin, const size_t end) {
+		std::array<uint32_t, kMaxCleaners> choice{};
+		const uint32_t all = (uint32_t(1) << board_->cleaners_) - 1;
+		for (size_t fi = begin; fi < end; ++fi) {
+			const auto &first = table.first_[fi];
+			choice[first.first] = first.second;
+			if (JoinPaths(table, all & ~(uint32_t(1) << first.first), table.cover_[first.first][first.second], choice)) return true;
+		}
+		if (--table.pending_ == 0 && !context_->stop_flg_) return MoveNonCombo(0, 0);
+		return false;
+	}
+	// 被覆エンジンで解く(経路が多すぎる場合と、掃除しなければならないマスがない場合は深さ優先探索に任せる)
+	bool SolveByCover() {
+		const size_t cleaners = board_->cleaners_;
+		const auto required = MustClean();
+		if (board_->max_depth_ > kCoverMaxSteps || required.None()) return MoveNonCombo(0, 0);
+		auto table = std::make_shared<CoverTable>();
+		table->cover_.resize(cleaners);
+		table->route_.resize(cleaners);
+		for (size_t ci = 0; ci < cleaners; ++ci) {
+			if (!EnumeratePaths(ci, table->cover_[ci], table->route_[ci])) return context_->stop_flg_ ? false : MoveNonCombo(0, 0);
+			// 捨てきれない経路しかない掃除人がいれば、組み合わせは作れない
+			if (table->cover_[ci].empty()) return MoveNonCombo(0, 0);
+		}
+		const size_t stride = board_->cells_stride_;
+		table->holder_.assign(cleaners, vector<vector<uint32_t>>(stride));
+		table->reach_.resize(cleaners);
+		table->holders_.assign(stride, 0);
+		for (size_t ci = 0; ci < cleaners; ++ci) {
+			for (size_t pi = 0; pi < table->cover_[ci].size(); ++pi) {
+				const auto &cover = table->cover_[ci][pi];
+				table->reach_[ci] |= cover;
+				cover.ForEach([this, &table, ci, pi](const size_t position) {
+					const size_t cell = board_->cell_id_[position];
+					table->holder_[ci][cell].push_back(static_cast<uint32_t>(pi));
+					++table->holders_[cell];
+				});
+			}
+		}
+		table->required_ = required;
+		const size_t target = FewestHolders(*table, required);
+		for (size_t ci = 0; ci < cleaners; ++ci) {
+			for (const auto pi : table->holder_[ci][target]) table->first_.emplace_back(ci, pi);
+		}
+		if (table->first_.empty()) return MoveNonCombo(0, 0);
+		// 最初に埋めるマスの候補を区切って、残りを他のワーカーに分ける
+		const size_t firsts = table->first_.size();
+		const size_t chunks = std::min(firsts, g_pool->Size() * 4);
+		table->pending_ = chunks;
+		for (size_t ki = 1; ki < chunks; ++ki) {
+			auto branch = std::make_shared<Query>(*this);
+			branch->table_hits_ = branch->table_misses_ = branch->nodes_ = branch->prune_checks_ = branch->prune_hits_ = 0;
+			branch->stats_.Clear();
+			const size_t begin = firsts * ki / chunks, end = firsts * (ki + 1) / chunks;
+			SpawnSearch(branch, [table, begin, end](Query &query) {
+				return query.JoinChunk(*table, begin, end);
+			});
+		}
+		return JoinChunk(*table, 0, firsts / chunks);
+	}
+	// スレッドプール上で探索を始める(終わるとcontextのon_finish_が呼ばれ、解けていれば解答欄に入っている)
+	// depthは探索を始める深さ(分担探索で、ApplyPrefixで進めた手順の続きから探索する場合に指定する)
+	void Start(SearchContext<Words, Width> *context, const bool combo_flg, const size_t depth = 0) const {
+		// 鉢合わせの扱いが違うと解けない局面も違うので、使用済みの置換表は空にする
+		// 最適化モードでは、解けないかどうかが最良の解で変わるので置換表を使わない
+		auto *table = context->table_;
+		if (table != nullptr && (!table->Enabled() || context->objective_ != Objective::None)) table = nullptr;
+		if (table != nullptr && !context->keep_table_flg_ && table->Hits() + table->Misses() > 0) table->Clear();
+		auto root = std::make_shared<Query>(*this);
+		root->context_ = context;
+		root->table_ = table;
+		root->combo_flg_ = combo_flg;
+		root->order_ = context->order_;
+		root->objective_ = context->objective_;
+		root->InitReachCount();
+		const bool cover_flg = context->cover_flg_ && !context->count_flg_ && context->objective_ == Objective::None && depth == 0 && context->prefix_depth_ == SIZE_MAX;
+		SpawnSearch(root, [combo_flg, cover_flg, depth](Query &query) {
+			return combo_flg ? query.MoveWithCombo(depth, 0) : cover_flg ? query.SolveByCover() : query.MoveNonCombo(depth, 0);
+		});
+	}
+	// 解答欄の盤面を自身に書き戻す
+	bool TakeAnswer(SearchContext<Words, Width> &context) {
+		if (!context.answer_) return false;
+		*this = std::move(*context.answer_);
+		context.answer_.reset();
+		context_ = nullptr;
+		table_ = nullptr;
+		return true;
+	}
+	// 移動の列(MoveCodesの形式)を、探索と同じく深さごとに番号順で進めて盤面に適用する(鉢合わせを考慮するなら、深さごとに範囲攻撃も行う)
+	// 分担探索で、割り当てられた手順の続きから探索したり、見つかった解答を再現したりするのに使う
+	// 全員が同じ深さ(最大歩数が短ければそこ)まで進む列でなければfalse
+	bool ApplyPrefix(const string &codes, const bool combo_flg) {
+		vector<string> moves(1);
+		for (const char code : codes) {
+			if (code == ',') moves.emplace_back();
+			else moves.back() += code;
+		}
+		if (moves.size() != std::max<size_t>(board_->cleaners_, 1)) return false;
+		size_t depth = 0;
+		for (const auto &move : moves) depth = std::max(depth, move.size());
+		for (size_t ci = 0; ci < board_->cleaners_; ++ci) {
+			if (moves[ci].size() != std::min<size_t>(depth, board_->move_max_[ci])) return false;
+		}
+		combo_flg_ = combo_flg;
+		InitReachCount();
+		for (size_t step = 0; step < depth; ++step) {
+			for (size_t ci = 0; ci < board_->cleaners_; ++ci) {
+				if (step >= moves[ci].size()) continue;
+				const size_t d = string("ULRD").find(moves[ci][step]);
+				const size_t position = cleaner_.position_now_[ci];
+				if (d == string::npos || ((board_->next_direction_[position] >> d) & 1) == 0) return false;
+				const size_t next = StepPosition(position, d, X());
+				if (step > 0 && next == cleaner_.position_old_[ci]) return false;
+				MoveCleanerForward(ci, next);
+			}
+			if (combo_flg_ && board_->meet_ahead_[step + 1] != 0) CleanCombo(step + 1);
+		}
+		// 手順より前には戻らないので、記録は持ち越さない
+		trail_.clear();
+		return true;
+	}
+	// 部分問題(Board::SubBoard)の解答を、全体の掃除人membersの移動として書き写す(床の状態は書き換えない)
+	void MergeAnswer(const Query &part, const vector<size_t> &members) noexcept {
+		for (size_t k = 0; k < members.size(); ++k) {
+			const size_t ci = members[k];
+			cleaner_.position_now_[ci] = part.cleaner_.position_now_[k];
+			cleaner_.position_old_[ci] = part.cleaner_.position_old_[k];
+			cleaner_.move_now_[ci] = part.cleaner_.move_now_[k];
+			cleaner_.move_end_[ci] = part.cleaner_.move_end_[k];
+			cleaner_.stock_[ci] = part.cleaner_.stock_[k];
+			const size_t words = (board_->move_max_[ci] + kMovesPerWord - 1) / kMovesPerWord;
+			std::copy_n(part.move_log_.data() + part.board_->move_log_offset_[k], words, move_log_.data() + board_->move_log_offset_[ci]);
+		}
+		combo_flg_ = combo_flg_ || part.combo_flg_;
+	}
+	// スレッドプール上で探索し、解けた場合は解答を自身に書き戻す
+	bool Solve(const bool combo_flg, SearchContext<Words, Width> &context) {
+		context.Reset();
+		Start(&context, combo_flg);
+		g_pool->Wait();
+		return TakeAnswer(context);
+	}
+	// 掃除人ciのstep歩目(0始まり)に進んだ向き(StepPositionの方向)
+	size_t MoveDirection(const size_t ci, const size_t step) const noexcept {
+		return (move_log_[board_->move_log_offset_[ci] + step / kMovesPerWord] >> (2 * (step % kMovesPerWord))) & 3;
+	}
+	// 解答を最初の盤面から歩かせ直して確かめる(Board::CheckAnswer)
+	string CheckAnswer(const bool full_flg) const {
+		return board_->CheckAnswer(MoveCodes(), combo_flg_, full_flg);
+	}
+	// 各掃除人の移動をU/D/L/Rの列で表した文字列(掃除人ごとにカンマで区切る)
+	string MoveCodes() const {
+		string codes;
+		for (size_t ci = 0; ci < board_->cleaners_; ++ci) {
+			if (ci > 0) codes += ',';
+			for (size_t step = 0; step < cleaner_.move_now_[ci]; ++step) codes += "ULRD"[MoveDirection(ci, step)];
+		}
+		return codes;
+	}
+	// 解答をJSONで書き出す
+	// {"width":横,"height":縦,"combo":鉢合わせを考慮したか,"cleaners":[{"type":"boy|girl|robot","start":[x,y],"steps":歩数,"moves":"U/D/L/Rの列"},...]}
+	void WriteAnswerJson(std::ostream &out) const {
+		const std::array<const char*, kCleanerTypes> type_names{ "boy", "girl", "robot" };
+		out << "{\"width\":" << board_->x_mini_ << ",\"height\":" << board_->y_mini_ << ",\"combo\":" << (combo_flg_ ? "true" : "false") << ",\"cleaners\":[";
+		for (size_t ci = 0; ci < board_->cleaners_; ++ci) {
+			const size_t position = board_->position_first_[ci];
+			out << (ci > 0 ? "," : "") << "{\"type\":\"" << type_names[TypeIndex(board_->cleaner_type_[ci])] << "\",\"start\":["
+				<< position % board_->x_ - 1 << "," << position / board_->x_ - 1 << "],\"steps\":" << size_t(cleaner_.move_now_[ci]) << ",\"moves\":\"";
+			for (size_t step = 0; step < cleaner_.move_now_[ci]; ++step) out << "ULRD"[MoveDirection(ci, step)];
+			out << "\"}";
+		}
+		out << "]}" << endl;
+	}
+	// 解答をバイナリで書き出す(多バイトの値はないので、バイト順には依存しない)
+	// "SWP1"・横・縦・人数・鉢合わせを考慮したか(1バイトずつ)、掃除人ごとに種類(0=男の子,1=女の子,2=ロボット)・x・y・歩数(1バイトずつ)、
+	// 続けて掃除人ごとに、向き(0=上,1=左,2=右,3=下)を1歩2ビットで下位ビットから詰めたもの(1人ぶんごとにバイト境界へ切り上げる)
+	void WriteAnswerBinary(std::ostream &out) const {
+		string bytes = "SWP1";
+		bytes += static_cast<char>(board_->x_mini_);
+		bytes += static_cast<char>(board_->y_mini_);
+		bytes += static_cast<char>(board_->cleaners_);
+		bytes += static_cast<char>(combo_flg_ ? 1 : 0);
+		for (size_t ci = 0; ci < board_->cleaners_; ++ci) {
+			const size_t position = board_->position_first_[ci];
+			bytes += static_cast<char>(TypeIndex(board_->cleaner_type_[ci]));
+			bytes += static_cast<char>(position % board_->x_ - 1);
+			bytes += static_cast<char>(position / board_->x_ - 1);
+			bytes += static_cast<char>(cleaner_.move_now_[ci]);
+		}
+		for (size_t ci = 0; ci < board_->cleaners_; ++ci) {
+			for (size_t step = 0; step < cleaner_.move_now_[ci]; step += 4) {
+				uint8_t packed = 0;
+				for (size_t k = 0; k < 4 && step + k < cleaner_.move_now_[ci]; ++k) packed |= static_cast<uint8_t>(MoveDirection(ci, step + k) << (2 * k));
+				bytes += static_cast<char>(packed);
+			}
+		}
+		out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
 	}
 	// 解答を表示する
 	void ShowAnswer() const noexcept{
-		for (size_t ci = 0; ci < cleaner_status_.size(); ++ci) {
-			switch (cleaner_status_[ci].type_) {
+		const std::array<const char*, kDirections> direction_names{ "(上)", "(左)", "(右)", "(下)" };
+		for (size_t ci = 0; ci < board_->cleaners_; ++ci) {
+			switch (board_->cleaner_type_[ci]) {
 			case Floor::Boy:
 				cout << "男の子";
 				break;
@@ -613,65 +2635,1623 @@ public:
 				cout << "Robot";
 				break;
 			}
-			cout << " " << GetPos(cleaner_status_[ci].position_first_);
-			size_t old_position = cleaner_status_[ci].position_first_;
-			size_t count = 0;
-			for (const auto &it_m : cleaner_move_[ci]) {
-				cout << "->" << GetPos(it_m);
-				if (old_position + 1 == it_m) {
-					cout << "(右)";
-				}
-				else if (it_m + 1 == old_position) {
-					cout << "(左)";
+			cout << " " << board_->GetPos(board_->position_first_[ci]);
+			size_t position = board_->position_first_[ci];
+			for (size_t step = 0; step < cleaner_.move_now_[ci]; ++step) {
+				const size_t d = MoveDirection(ci, step);
+				position = StepPosition(position, d, board_->x_);
+				cout << "->" << board_->GetPos(position) << direction_names[d];
+				if ((step + 1) % 5 == 0) cout << "\n　　　";
+			}
+			cout << endl;
+		}
+	}
+};
+
+// コマンドラインオプション
+struct Options {
+	string file_name_;			//問題ファイル(バッチモードではディレクトリかパックファイル)
+	size_t max_threads_;		//スレッド数
+	bool must_combo_flg_;		//最初から鉢合わせを考慮して検索するか
+	size_t table_megabytes_;	//置換表の大きさ(MB単位、0なら使わない)
+	bool batch_flg_;			//バッチモードか
+	size_t limit_ms_;			//1問あたりの制限時間(ミリ秒、0なら無制限)
+	bool bench_flg_;			//ベンチマークモードか(file_name_はベンチマークの一覧ファイル)
+	size_t repeat_;				//ベンチマークで1件を何回解くか
+	vector<size_t> bench_threads_;	//ベンチマークで試すスレッド数
+	string baseline_file_;		//ベンチマークで比べる基準値のファイル
+	string save_file_;			//ベンチマークの結果を保存するファイル
+	size_t progress_ms_;		//進捗を標準エラー出力に書く間隔(ミリ秒、0なら書かない)
+	string stats_file_;			//探索の統計をJSONで書き出すファイル
+	string answer_file_;		//解答を書き出すファイル(拡張子が.jsonならJSON、それ以外はバイナリ)
+	bool count_flg_;			//解を全部数えるか
+	uint64_t solution_limit_;	//解を数える上限(0なら無制限)
+	string solutions_file_;		//数えた解を1行ずつ書き出すファイル
+	Objective objective_;		//最適化モードで小さくする量(Noneなら最適化しない)
+	bool landmark_flg_;			//小さな盤面でも、大きな盤面と同じく目印のマスで最小移動歩数の下界を求めるか
+	string spool_dir_;			//分担探索の作業ディレクトリ(空なら分担しない)
+	size_t shards_;				//分担探索で書き出す手順の数の目安(これ以上になるまで深さを増やす)
+	bool worker_flg_;			//分担探索の作業者か(file_name_は作業ディレクトリ)
+	MoveOrder order_;			//移動先を試す順番
+	bool cover_flg_;			//鉢合わせを考慮しない場合に被覆エンジンを使うか
+	bool portfolio_flg_;		//鉢合わせを考慮しない探索と考慮する探索を同時に走らせるか
+	vector<MoveOrder> portfolio_orders_;	//同時に走らせる移動順(空ならorder_だけ)
+};
+
+// 「input.txt [threads] [--name=value...]」を読み取る(誤りがあればfalse)
+bool ParseOptions(const int argc, char *argv[], Options &options) {
+	options.max_threads_ = 1;
+	options.must_combo_flg_ = false;
+	options.table_megabytes_ = 64;
+	options.batch_flg_ = false;
+	options.limit_ms_ = 0;
+	options.bench_flg_ = false;
+	options.repeat_ = 3;
+	options.bench_threads_ = { 1, 2, 4 };
+	options.progress_ms_ = 0;
+	options.order_ = MoveOrder::Fixed;
+	options.cover_flg_ = false;
+	options.portfolio_flg_ = false;
+	options.count_flg_ = false;
+	options.solution_limit_ = 0;
+	options.objective_ = Objective::None;
+	options.landmark_flg_ = false;
+	options.shards_ = 64;
+	options.worker_flg_ = false;
+	vector<string> positional;
+	try {
+		for (int ai = 1; ai < argc; ++ai) {
+			const string arg = argv[ai];
+			if (arg.compare(0, 2, "--") != 0) {
+				positional.push_back(arg);
+				continue;
+			}
+			const auto equal = arg.find('=');
+			const string name = arg.substr(2, equal == string::npos ? string::npos : equal - 2);
+			const string value = (equal == string::npos ? "" : arg.substr(equal + 1));
+			if (name == "tt") {
+				options.table_megabytes_ = std::stoul(value);
+			}
+			else if (name == "batch" && equal == string::npos) {
+				options.batch_flg_ = true;
+			}
+			else if (name == "limit") {
+				options.limit_ms_ = std::stoul(value);
+			}
+			else if (name == "bench" && equal == string::npos) {
+				options.bench_flg_ = true;
+			}
+			else if (name == "repeat") {
+				options.repeat_ = std::max<size_t>(std::stoul(value), 1);
+			}
+			else if (name == "threads") {
+				options.bench_threads_.clear();
+				std::istringstream list(value);
+				string item;
+				while (std::getline(list, item, ',')) options.bench_threads_.push_back(std::max<size_t>(std::stoul(item), 1));
+				if (options.bench_threads_.empty()) return false;
+			}
+			else if (name == "baseline") {
+				options.baseline_file_ = value;
+			}
+			else if (name == "save") {
+				options.save_file_ = value;
+			}
+			else if (name == "progress") {
+				options.progress_ms_ = std::stoul(value);
+			}
+			else if (name == "stats") {
+				options.stats_file_ = value;
+			}
+			else if (name == "answer") {
+				options.answer_file_ = value;
+			}
+			else if (name == "count") {
+				options.count_flg_ = true;
+				options.solution_limit_ = (value.empty() ? 0 : std::stoull(value));
+			}
+			else if (name == "solutions") {
+				options.solutions_file_ = value;
+			}
+			else if (name == "large" && equal == string::npos) {
+				options.landmark_flg_ = true;
+			}
+			else if (name == "spool" && !value.empty()) {
+				options.spool_dir_ = value;
+			}
+			else if (name == "shards") {
+				options.shards_ = std::max<size_t>(std::stoul(value), 1);
+			}
+			else if (name == "worker" && equal == string::npos) {
+				options.worker_flg_ = true;
+			}
+			else if (name == "optimize") {
+				const auto it = std::find_if(kObjectiveNames.begin() + 1, kObjectiveNames.end(), [&value](const char *objective_name) { return value == objective_name; });
+				if (!value.empty() && it == kObjectiveNames.end()) return false;
+				options.objective_ = (value.empty() ? Objective::Total : static_cast<Objective>(it - kObjectiveNames.begin()));
+			}
+			else if (name == "order") {
+				const auto it = std::find_if(kMoveOrderNames.begin(), kMoveOrderNames.end(), [&value](const char *order_name) { return value == order_name; });
+				if (it == kMoveOrderNames.end()) return false;
+				options.order_ = static_cast<MoveOrder>(it - kMoveOrderNames.begin());
+			}
+			else if (name == "engine" && (value == "cover" || value == "dfs")) {
+				options.cover_flg_ = (value == "cover");
+			}
+			else if (name == "portfolio") {
+				options.portfolio_flg_ = true;
+				options.portfolio_orders_.clear();
+				std::istringstream list(value);
+				string item;
+				while (std::getline(list, item, ',')) {
+					const auto it = std::find_if(kMoveOrderNames.begin(), kMoveOrderNames.end(), [&item](const char *order_name) { return item == order_name; });
+					if (it == kMoveOrderNames.end()) return false;
+					options.portfolio_orders_.push_back(static_cast<MoveOrder>(it - kMoveOrderNames.begin()));
 				}
-				else if (old_position + x_ == it_m) {
-					cout << "(下)";
+			}
+			else {
+				return false;
+			}
+		}
+		if (positional.empty() || positional.size() > 2) return false;
+		// 解を数えるのと最適化するのは1つの探索を調べ尽くすモードなので、ポートフォリオとも互いとも組み合わせられない
+		if ((options.count_flg_ || options.objective_ != Objective::None) && options.portfolio_flg_) return false;
+		if (options.count_flg_ && options.objective_ != Objective::None) return false;
+		// 分担探索は最初の解で打ち切る探索だけを分ける
+		if (!options.spool_dir_.empty() && (options.count_flg_ || options.objective_ != Objective::None || options.portfolio_flg_ || options.batch_flg_ || options.worker_flg_)) return false;
+		options.file_name_ = positional[0];
+		if (positional.size() >= 2) {
+			int max_threads = std::stoi(positional[1]);
+			if (max_threads == 0) {
+				max_threads = 1;
+			}else if (max_threads < 0) {
+				options.must_combo_flg_ = true;
+				max_threads = -max_threads;
+			}
+			options.max_threads_ = max_threads;
+		}
+	}
+	catch (const std::logic_error&) {
+		return false;
+	}
+	return true;
+}
+
+// 問題ファイルから1問読み込む(読めなければ例外を投げる)
+std::shared_ptr<const Board> LoadBoard(const string &file_name, const bool landmark_flg) {
+	std::ifstream fin;
+	fin.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+	fin.open(file_name);
+	return std::make_shared<const Board>(fin, landmark_flg);
+}
+
+// 横幅ごとに特殊化する盤面の大きさ(横・縦とも5～12マスの盤面。番兵込みの横幅は7～14)
+const size_t kFixedSizeMin = 5, kFixedSizeMax = 12;
+
+// 盤面がよくある大きさなら番兵込みの横幅で特殊化した探索を、そうでなければ横幅を実行時に読む探索(Width=0)を選ぶ
+// Words語のビットボードに収まりえない横幅は特殊化しない
+template<size_t Words, size_t Width = kFixedSizeMin + 2, typename Function>
+void DispatchWidth(const Board &board, Function func) {
+	if constexpr (Width > kFixedSizeMax + 2 || Width * (kFixedSizeMin + 2) > BitBoard<Words>::kBits) {
+		func(std::integral_constant<size_t, Words>(), std::integral_constant<size_t, 0>());
+	}
+	else {
+		if (board.x_ == Width && board.y_mini_ >= kFixedSizeMin && board.y_mini_ <= kFixedSizeMax) {
+			func(std::integral_constant<size_t, Words>(), std::integral_constant<size_t, Width>());
+		}
+		else {
+			DispatchWidth<Words, Width + 1>(board, func);
+		}
+	}
+}
+
+// 番兵込みのマス数が収まる最小のビットボードと、横幅の特殊化を選んでfuncを呼ぶ(16x16までは6語以内、126x126までは256語以内に収まる)
+// 盤面が大きすぎる場合はfalse
+template<typename Function>
+bool DispatchSolver(const Board &board, Function func) {
+	const size_t cells = board.x_ * board.y_;
+	if (cells <= BitBoard<1>::kBits) {
+		DispatchWidth<1>(board, func);
+	}
+	else if (cells <= BitBoard<4>::kBits) {
+		DispatchWidth<4>(board, func);
+	}
+	else if (cells <= BitBoard<6>::kBits) {
+		func(std::integral_constant<size_t, 6>(), std::integral_constant<size_t, 0>());
+	}
+	else if (cells <= BitBoard<64>::kBits) {
+		func(std::integral_constant<size_t, 64>(), std::integral_constant<size_t, 0>());
+	}
+	else if (cells <= BitBoard<256>::kBits) {
+		func(std::integral_constant<size_t, 256>(), std::integral_constant<size_t, 0>());
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+// 探索中の進捗(経過時間・ノード数・ノード/秒・枝刈り率)を一定間隔で標準エラー出力に書く
+template<size_t Words, size_t Width>
+class ProgressReporter {
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	bool stop_flg_;
+	std::thread thread_;
+public:
+	// interval_msが0なら何もしない
+	ProgressReporter(const SearchContext<Words, Width> &context, const size_t interval_ms) : ProgressReporter(vector<const SearchContext<Words, Width>*>{ &context }, interval_ms) {}
+	// 複数の探索を同時に走らせる場合は、その合計を表示する
+	ProgressReporter(const vector<const SearchContext<Words, Width>*> &contexts, const size_t interval_ms) : stop_flg_(false) {
+		if (interval_ms == 0) return;
+		thread_ = std::thread([this, contexts, interval_ms] {
+			const auto begin_time = std::chrono::high_resolution_clock::now();
+			std::unique_lock<std::mutex> lock(mutex_);
+			while (!cv_.wait_for(lock, std::chrono::milliseconds(interval_ms), [this] { return stop_flg_; })) {
+				const double sec = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin_time).count();
+				uint64_t nodes = 0, prune_checks = 0, prune_hits = 0;
+				for (const auto *context : contexts) {
+					nodes += context->nodes_;
+					prune_checks += context->prune_checks_;
+					prune_hits += context->prune_hits_;
 				}
-				else {
-					cout << "(上)";
+				std::cerr << "[" << std::fixed << std::setprecision(1) << sec << "s] ノード数" << nodes
+					<< " (" << static_cast<uint64_t>(nodes / sec) << "/s), 枝刈り率" << (prune_checks == 0 ? 0.0 : prune_hits * 100.0 / prune_checks) << "%" << endl;
+			}
+		});
+	}
+	~ProgressReporter() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_flg_ = true;
+		}
+		cv_.notify_all();
+		if (thread_.joinable()) thread_.join();
+	}
+};
+
+// ポートフォリオモードで同時に走らせる探索1本
+template<size_t Words, size_t Width>
+struct PortfolioRacer {
+	// 鉢合わせを考慮するかと、移動先を試す順番
+	bool combo_flg_;
+	MoveOrder order_;
+	TranspositionTable table_;
+	SearchContext<Words, Width> context_;
+	// 探索を始めてから終わるまでの時間[ms]と、結果(solved/unsolvable/timeout/cancelled)(最後のタスクが終わったときに書く)
+	long long ms_;
+	const char *status_;
+	PortfolioRacer(const bool combo_flg, const MoveOrder order, const size_t table_megabytes)
+		: combo_flg_(combo_flg), order_(order), table_(table_megabytes), context_(&table_), ms_(0), status_("cancelled") {}
+};
+
+// 鉢合わせを考慮しない探索と考慮する探索を移動順ごとに同時に走らせ、最初に見つかった解答を使う
+// どれかが解けるか、鉢合わせを考慮する探索が解けないと確かめた時点で、取り消しトークンで残りを打ち切る
+// (スレッドプールは全員で共有し、分割された枝を暇なワーカーが盗むことでスレッドを分け合う。置換表は本数で等分する)
+template<size_t Words, size_t Width>
+class Portfolio {
+	const Options &options_;
+	vector<std::unique_ptr<PortfolioRacer<Words, Width>>> racers_;
+	CancelToken cancel_;
+public:
+	// 置換表の確保に時間がかかるので、探索を始める前に作っておく
+	explicit Portfolio(const Options &options) : options_(options) {
+		auto orders = options.portfolio_orders_;
+		if (orders.empty()) orders.push_back(options.order_);
+		const size_t modes = (options.must_combo_flg_ ? 1 : 2);
+		const size_t table_megabytes = options.table_megabytes_ / (modes * orders.size());
+		for (size_t mi = 2 - modes; mi < 2; ++mi) {
+			for (const auto order : orders) racers_.push_back(std::make_unique<PortfolioRacer<Words, Width>>(mi == 1, order, table_megabytes));
+		}
+	}
+	// 解けたら解答をqueryに書き戻す(解けなかった場合、時間切れならexpiredをtrueにする)
+	bool Race(Query<Words, Width> &query, vector<string> &phases, bool &expired) {
+		const auto begin_time = std::chrono::high_resolution_clock::now();
+		vector<const SearchContext<Words, Width>*> contexts;
+		for (auto &racer : racers_) {
+			auto *raw = racer.get();
+			auto &context = raw->context_;
+			context.SetLimit(options_.limit_ms_);
+			context.order_ = raw->order_;
+			context.cover_flg_ = options_.cover_flg_;
+			context.cancel_ = &cancel_;
+			context.on_finish_ = [this, raw, begin_time] {
+				raw->ms_ = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - begin_time).count();
+				raw->status_ = raw->context_.answer_ ? "solved" : cancel_.Cancelled() ? "cancelled" : raw->context_.Expired() ? "timeout" : "unsolvable";
+				// 鉢合わせを考慮しても解けないなら、他の探索も解けない
+				if (raw->combo_flg_ && string(raw->status_) == "unsolvable") cancel_.Cancel();
+			};
+			contexts.push_back(&context);
+		}
+		{
+			ProgressReporter<Words, Width> progress(contexts, options_.progress_ms_);
+			for (auto &racer : racers_) query.Start(&racer->context_, racer->combo_flg_);
+			g_pool->Wait();
+		}
+		// 最も早く解けた探索の解答を使う
+		PortfolioRacer<Words, Width> *winner = nullptr;
+		bool proved_flg = false;
+		for (auto &racer : racers_) {
+			const auto &context = racer->context_;
+			std::ostringstream json;
+			json << "{\"combo\":" << (racer->combo_flg_ ? "true" : "false") << ",\"order\":\"" << kMoveOrderNames[static_cast<size_t>(racer->order_)]
+				<< "\",\"result\":\"" << racer->status_ << "\",\"ms\":" << racer->ms_ << ",\"nodes\":" << context.nodes_
+				<< ",\"prune_checks\":" << context.prune_checks_ << ",\"prune_hits\":" << context.prune_hits_
+				<< ",\"table_hits\":" << racer->table_.Hits() << ",\"table_misses\":" << racer->table_.Misses() << ",\"stats\":" << context.stats_.ToJson() << "}";
+			phases.push_back(json.str());
+			if (context.answer_ && (winner == nullptr || racer->ms_ < winner->ms_)) winner = racer.get();
+			if (racer->combo_flg_ && string(racer->status_) == "unsolvable") proved_flg = true;
+		}
+		expired = (winner == nullptr && !proved_flg && racers_.front()->context_.Expired());
+		if (winner == nullptr) return false;
+		cout << "ポートフォリオ：鉢合わせを考慮" << (winner->combo_flg_ ? "する" : "しない") << "探索(" << kMoveOrderNames[static_cast<size_t>(winner->order_)] << ")が解きました" << endl;
+		return query.TakeAnswer(winner->context_);
+	}
+};
+
+// 分割して解く場合の、1組ぶんの部分問題
+template<size_t Words, size_t Width>
+struct GroupPart {
+	// 全体での掃除人の番号(部分問題ではこの順に0から振り直す)
+	vector<size_t> members_;
+	TranspositionTable table_;
+	SearchContext<Words, Width> context_;
+	// 最初の盤面と、これまでに見つけた解答(最適化モードでは最良の解)
+	Query<Words, Width> query_, answer_;
+	// 解けたか
+	bool solved_flg_;
+	// この組の探索だけを打ち切る取り消しトークン(解けた組が他の組の探索まで止めないよう、組ごとに持つ)
+	CancelToken cancel_;
+	GroupPart(const vector<size_t> &members, std::shared_ptr<const Board> board, const size_t table_megabytes)
+		: members_(members), table_(table_megabytes), context_(&table_), query_(std::move(board)), answer_(query_), solved_flg_(false) {}
+};
+
+// 掃除人を互いにかち合わない組(Board::Decompose)に分け、組ごとの部分問題を同じスレッドプールで同時に解いて、解答をつなぎ合わせる
+// 鉢合わせを考慮する探索をやり直すのは、考慮しない探索で解けなかった組だけ(最適化モードでは全組)
+// どれかの組が鉢合わせを考慮しても解けないと確かめた時点で、全組の取り消しトークンで残りを打ち切る(置換表は組の数で等分する)
+template<size_t Words, size_t Width>
+class Decomposition {
+	const Options &options_;
+	vector<std::unique_ptr<GroupPart<Words, Width>>> parts_;
+	CancelToken cancel_;
+	// 探索が必要な組をまとめて探索し、1組1件の統計をphasesに積む
+	void Phase(const bool combo_flg, vector<string> &phases) {
+		vector<size_t> targets;
+		vector<uint64_t> nodes, prune_checks, prune_hits;
+		for (size_t gi = 0; gi < parts_.size(); ++gi) {
+			auto *raw = parts_[gi].get();
+			// 最適化モードでは、解けた組も鉢合わせを考慮してさらに詰める
+			if (raw->solved_flg_ && !(combo_flg && options_.objective_ != Objective::None)) continue;
+			if (raw->context_.Expired()) continue;
+			raw->context_.Reset();
+			raw->context_.on_finish_ = [this, raw, combo_flg] {
+				// 鉢合わせを考慮しても解けない組があれば、全体も解けないので全組を打ち切る
+				if (combo_flg && !raw->solved_flg_ && !raw->context_.answer_ && !raw->context_.Expired() && !raw->context_.Cancelled()) {
+					cancel_.Cancel();
+					for (auto &part : parts_) part->cancel_.Cancel();
 				}
-				old_position = it_m;
-				++count;
-				if (count % 5 == 0) cout << "\n　　　";
+			};
+			targets.push_back(gi);
+			nodes.push_back(raw->context_.nodes_);
+			prune_checks.push_back(raw->context_.prune_checks_);
+			prune_hits.push_back(raw->context_.prune_hits_);
+		}
+		const auto begin_time = std::chrono::high_resolution_clock::now();
+		for (const auto gi : targets) parts_[gi]->query_.Start(&parts_[gi]->context_, combo_flg);
+		g_pool->Wait();
+		const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - begin_time).count();
+		for (size_t ti = 0; ti < targets.size(); ++ti) {
+			auto *part = parts_[targets[ti]].get();
+			auto &context = part->context_;
+			const bool flg = part->answer_.TakeAnswer(context);
+			part->solved_flg_ = part->solved_flg_ || flg;
+			const char *status = flg ? "solved" : context.Cancelled() ? "cancelled" : context.Expired() ? "timeout" : part->solved_flg_ ? "unimproved" : "unsolvable";
+			std::ostringstream json;
+			json << "{\"group\":" << targets[ti] << ",\"cleaners\":" << part->members_.size() << ",\"combo\":" << (combo_flg ? "true" : "false") << ",\"result\":\"" << status
+				<< "\",\"ms\":" << ms << ",\"nodes\":" << context.nodes_ - nodes[ti] << ",\"prune_checks\":" << context.prune_checks_ - prune_checks[ti]
+				<< ",\"prune_hits\":" << context.prune_hits_ - prune_hits[ti];
+			if (context.objective_ != Objective::None && part->solved_flg_) json << ",\"best_cost\":" << context.best_cost_;
+			json << ",\"stats\":" << context.stats_.ToJson() << "}";
+			phases.push_back(json.str());
+			context.stats_.Clear();
+		}
+	}
+public:
+	// 部分問題の盤面と置換表の用意に時間がかかるので、探索を始める前に作っておく
+	Decomposition(const Board &board, const vector<vector<size_t>> &groups, const Options &options) : options_(options) {
+		for (const auto &members : groups) {
+			parts_.push_back(std::make_unique<GroupPart<Words, Width>>(members, board.SubBoard(members), options.table_megabytes_ / groups.size()));
+		}
+	}
+	// 解けたら、つなぎ合わせた解答をqueryに書き込み、最適化モードなら全体のコストをbest_costに書く
+	// (解けなかった場合、時間切れならexpiredをtrueにする。解けた場合も、時間切れで打ち切った組があればtrueにする)
+	bool Solve(Query<Words, Width> &query, vector<string> &phases, bool &expired, size_t &best_cost) {
+		vector<const SearchContext<Words, Width>*> contexts;
+		for (auto &part : parts_) {
+			auto &context = part->context_;
+			context.SetLimit(options_.limit_ms_);
+			context.order_ = options_.order_;
+			context.cover_flg_ = options_.cover_flg_;
+			context.objective_ = options_.objective_;
+			context.cancel_ = &part->cancel_;
+			contexts.push_back(&context);
+		}
+		{
+			ProgressReporter<Words, Width> progress(contexts, options_.progress_ms_);
+			if (!options_.must_combo_flg_) Phase(false, phases);
+			Phase(true, phases);
+		}
+		bool flg = true;
+		expired = false;
+		best_cost = 0;
+		for (const auto &part : parts_) {
+			flg = flg && part->solved_flg_;
+			expired = expired || part->context_.Expired();
+			const size_t cost = part->context_.best_cost_;
+			best_cost = (options_.objective_ == Objective::Makespan ? std::max(best_cost, cost) : best_cost + cost);
+		}
+		if (!flg) {
+			// 解けないと確かめた組があれば、時間切れではない
+			expired = expired && !cancel_.Cancelled();
+			return false;
+		}
+		for (const auto &part : parts_) query.MergeAnswer(part->answer_, part->members_);
+		return true;
+	}
+	// 組の数
+	size_t Groups() const noexcept {
+		return parts_.size();
+	}
+	// 全組の探索の統計の合計(ノード数・枝刈りを試した回数・枝刈りした回数)
+	std::tuple<uint64_t, uint64_t, uint64_t> Counts() const noexcept {
+		uint64_t nodes = 0, prune_checks = 0, prune_hits = 0;
+		for (const auto &part : parts_) {
+			nodes += part->context_.nodes_;
+			prune_checks += part->context_.prune_checks_;
+			prune_hits += part->context_.prune_hits_;
+		}
+		return { nodes, prune_checks, prune_hits };
+	}
+};
+
+// 解答をファイルに書き出す(拡張子が.jsonならJSON、それ以外はバイナリ。file_nameが空なら書かない)
+template<size_t Words, size_t Width>
+void SaveAnswer(const Query<Words, Width> &query, const string &file_name) {
+	if (file_name.empty()) return;
+	const bool json_flg = file_name.size() >= 5 && file_name.compare(file_name.size() - 5, 5, ".json") == 0;
+	std::ofstream fout(file_name, json_flg ? std::ios::out : std::ios::out | std::ios::binary);
+	if (json_flg) query.WriteAnswerJson(fout);
+	else query.WriteAnswerBinary(fout);
+}
+
+// 最適化モードで解く(solveは、鉢合わせを考慮するかを受け取ってqueryを探索する関数)
+// 鉢合わせを考慮しない最良の解を先に求め、そのコストを上限にして、鉢合わせを考慮する探索でさらに詰める
+// (鉢合わせを考慮しない解は、考慮しても解のままなので上限に使える)
+template<size_t Words, size_t Width, typename Function>
+bool SolveOptimized(Query<Words, Width> &query, const SearchContext<Words, Width> &context, const bool must_combo_flg, Function solve) {
+	const auto initial = query;
+	bool flg = !must_combo_flg && solve(false);
+	if (!context.Expired()) {
+		auto best = std::move(query);
+		query = initial;
+		if (solve(true)) flg = true;
+		else query = std::move(best);
+	}
+	return flg;
+}
+
+// 盤面の大きさに合ったビットボードで解く
+template<size_t Words, size_t Width>
+void Run(std::shared_ptr<const Board> board, const Options &options, const long long startup_ms) {
+	// 掃除人が互いにかち合わない組に分かれるなら、組ごとに解く(解を数える場合とポートフォリオモードでは分けない)
+	std::unique_ptr<Decomposition<Words, Width>> decomposition;
+	if (!options.count_flg_ && !options.portfolio_flg_) {
+		const auto groups = board->Decompose();
+		if (groups.size() >= 2) decomposition = std::make_unique<Decomposition<Words, Width>>(*board, groups, options);
+	}
+	Query<Words, Width> query(std::move(board));
+	// ポートフォリオモードと分割して解く場合は、探索ごとに置換表を持つ
+	TranspositionTable table(options.portfolio_flg_ || decomposition ? 0 : options.table_megabytes_);
+	std::unique_ptr<Portfolio<Words, Width>> portfolio;
+	if (options.portfolio_flg_) portfolio = std::make_unique<Portfolio<Words, Width>>(options);
+	SearchContext<Words, Width> context(&table);
+	context.SetLimit(options.limit_ms_);
+	context.order_ = options.order_;
+	context.cover_flg_ = options.cover_flg_;
+	// 解を全部数える場合は、見つけた解を書き出すファイルも開いておく
+	std::ofstream solution_out;
+	context.count_flg_ = options.count_flg_;
+	context.solution_limit_ = options.solution_limit_;
+	context.objective_ = options.objective_;
+	if (options.count_flg_ && !options.solutions_file_.empty()) {
+		solution_out.open(options.solutions_file_);
+		context.solution_out_ = &solution_out;
+	}
+	query.Put();
+	bool flg, expired, last_combo_flg = false;
+	size_t best_cost = SIZE_MAX;
+	const auto process_begin_time = std::chrono::high_resolution_clock::now();
+	auto process_end_time = process_begin_time;
+	// 探索1回ぶんの統計をJSONにしておく
+	vector<string> phases;
+	const auto solve = [&query, &context, &phases, &last_combo_flg](const bool combo_flg) {
+		last_combo_flg = combo_flg;
+		const uint64_t nodes = context.nodes_, prune_checks = context.prune_checks_, prune_hits = context.prune_hits_;
+		const auto begin_time = std::chrono::high_resolution_clock::now();
+		const bool flg = query.Solve(combo_flg, context);
+		const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - begin_time).count();
+		std::ostringstream json;
+		json << "{\"combo\":" << (combo_flg ? "true" : "false") << ",\"result\":\"" << (flg ? "solved" : context.Expired() ? "timeout" : "unsolvable")
+			<< "\",\"ms\":" << ms << ",\"nodes\":" << context.nodes_ - nodes << ",\"prune_checks\":" << context.prune_checks_ - prune_checks
+			<< ",\"prune_hits\":" << context.prune_hits_ - prune_hits;
+		if (context.count_flg_) json << ",\"solutions\":" << context.solutions_;
+		if (context.objective_ != Objective::None && flg) json << ",\"best_cost\":" << context.best_cost_;
+		json << ",\"stats\":" << context.stats_.ToJson() << "}";
+		phases.push_back(json.str());
+		context.stats_.Clear();
+		return flg;
+	};
+	if (portfolio) {
+		flg = portfolio->Race(query, phases, expired);
+		process_end_time = std::chrono::high_resolution_clock::now();
+	}
+	else if (decomposition) {
+		cout << "分割：掃除人を" << decomposition->Groups() << "組に分けて解きます" << endl;
+		flg = decomposition->Solve(query, phases, expired, best_cost);
+		process_end_time = std::chrono::high_resolution_clock::now();
+	}
+	else {
+		ProgressReporter<Words, Width> progress(context, options.progress_ms_);
+		if (options.objective_ != Objective::None) {
+			flg = SolveOptimized(query, context, options.must_combo_flg_, solve);
+			process_end_time = std::chrono::high_resolution_clock::now();
+		}
+		else if (!options.must_combo_flg_) {
+			flg = solve(false);
+			process_end_time = std::chrono::high_resolution_clock::now();
+			if (!flg && !context.Expired()) {
+				cout << "..." << std::chrono::duration_cast<std::chrono::milliseconds>(process_end_time - process_begin_time).count() << "[ms]..." << endl;
+				flg = solve(true);
+				process_end_time = std::chrono::high_resolution_clock::now();
 			}
-			cout << endl;
 		}
+		else {
+			flg = solve(true);
+			process_end_time = std::chrono::high_resolution_clock::now();
+		}
+		expired = context.Expired();
+		best_cost = context.best_cost_;
+	}
+	if (flg) {
+		query.ShowAnswer();
+		SaveAnswer(query, options.answer_file_);
+	}
+	else if (expired) cout << "時間切れです." << endl;
+	if (flg && options.objective_ != Objective::None) {
+		// 時間切れなら、見つけた中で最良の解でしかない
+		cout << (options.objective_ == Objective::Makespan ? "最後の掃除人が歩き終えるまでの歩数" : "全員の歩数の合計") << "：" << best_cost << "歩"
+			<< (expired ? "(時間切れのため最小とは限りません)" : "(最小)") << endl;
+	}
+	if (options.count_flg_) {
+		// 上限に達したか時間切れなら、数えた解の数は下限でしかない
+		const uint64_t solutions = context.solutions_, limit = options.solution_limit_;
+		cout << "解の数(鉢合わせを考慮" << (last_combo_flg ? "する" : "しない") << ")：" << (limit != 0 ? std::min(solutions, limit) : solutions)
+			<< (limit != 0 && solutions >= limit ? "個以上(上限で打ち切り)" : expired ? "個以上(時間切れ)" : "個") << endl;
+	}
+	if (table.Enabled()) cout << "置換表：ヒット" << table.Hits() << "回, ミス" << table.Misses() << "回" << endl;
+	cout << "前処理時間：" << startup_ms << "[ms]" << endl;
+	cout << "処理時間：" << std::chrono::duration_cast<std::chrono::milliseconds>(process_end_time - process_begin_time).count() << "[ms]\n" << endl;
+	if (!options.stats_file_.empty()) {
+		std::ofstream fout(options.stats_file_);
+		fout << "{\"stats_enabled\":" << (kStatsEnabled ? "true" : "false") << ",\"table_hits\":" << table.Hits() << ",\"table_misses\":" << table.Misses()
+			<< ",\"startup_ms\":" << startup_ms << ",\"phases\":[";
+		for (size_t pi = 0; pi < phases.size(); ++pi) fout << (pi > 0 ? "," : "") << phases[pi];
+		fout << "]}" << endl;
+	}
+}
+
+// 分担探索で、作業ディレクトリの状態を見に行く間隔[ms]
+const size_t kSpoolPollMs = 50;
+// 分担探索で、探索中の手順の更新時刻を今にする間隔[ms]と、更新されない手順を作業者が落ちたとみなしてtodo/に戻すまでの時間[ms]
+const size_t kSpoolHeartbeatMs = 1000;
+const size_t kSpoolStaleMs = 10000;
+
+// 分担探索の作業ディレクトリ(同じマシンの複数のプロセスや、共有したディレクトリ越しに複数のマシンで使う)
+// puzzle.txt(問題)、todo/(未着手の手順)、work/(誰かが着手した手順)、done/(手順ごとの結果)、stop(あれば全員打ち切る)、finish(手順をもう追加しない)からなる
+// 手順は1件1ファイルで、中身は「深さ<TAB>移動の列(MoveCodesの形式)」の1行。名前は鉢合わせを考慮しない(n)/する(c)と、探索順の通し番号
+// 着手はtodo/からwork/への名前の変更で行うので、同時に取り合っても1人しか取れない
+// 作業者は探索中の手順の更新時刻をkSpoolHeartbeatMsごとに今にし、調整役はkSpoolStaleMs以上更新されない手順をtodo/に戻す(落ちた作業者の手順を取り直すため)
+class Spool {
+	std::filesystem::path dir_;
+	// 書きかけのファイルにつける、プロセスごとの印(同じ手順の結果を2人が書いても、書きかけ同士がぶつからないように)
+	string tag_;
+public:
+	explicit Spool(const string &dir) : dir_(dir) {
+		std::random_device device;
+		std::ostringstream tag;
+		tag << std::hex << device() << device();
+		tag_ = tag.str();
+	}
+	std::filesystem::path Path(const char *name) const {
+		return dir_ / name;
+	}
+	bool Exists(const char *name) const {
+		std::error_code error;
+		return std::filesystem::exists(dir_ / name, error);
+	}
+	void Touch(const char *name) const {
+		std::ofstream fout(dir_ / name);
+	}
+	// 前回の作業の残りを消して、問題(問題ファイルの中身)を置く(書きかけを読まれないよう、別名で書いてから名前を変える)
+	void Prepare(const string &puzzle) const {
+		namespace fs = std::filesystem;
+		for (const auto *name : { "todo", "work", "done", "stop", "finish", "puzzle.txt" }) fs::remove_all(dir_ / name);
+		for (const auto *name : { "todo", "work", "done" }) fs::create_directories(dir_ / name);
+		{
+			std::ofstream fout(dir_ / "puzzle.tmp");
+			fout.exceptions(std::ostream::failbit | std::ostream::badbit);
+			fout << puzzle;
+		}
+		fs::rename(dir_ / "puzzle.tmp", dir_ / "puzzle.txt");
+	}
+	// 手順を1件置く
+	void Post(const char phase, const size_t index, const size_t depth, const string &codes) const {
+		std::ostringstream name;
+		name << phase << std::setw(6) << std::setfill('0') << index << ".txt";
+		const auto temp = dir_ / (name.str() + ".tmp");
+		{
+			std::ofstream fout(temp);
+			fout << depth << '\t' << codes << '\n';
+		}
+		std::filesystem::rename(temp, dir_ / "todo" / name.str());
+	}
+	// 未着手の手順を名前順に1件取る(取れなければfalse)
+	bool Claim(string &name, size_t &depth, string &codes) const {
+		namespace fs = std::filesystem;
+		std::error_code error;
+		vector<fs::path> files;
+		for (fs::directory_iterator it(dir_ / "todo", error), end; !error && it != end; it.increment(error)) {
+			if (it->path().extension() == ".txt") files.push_back(it->path());
+		}
+		std::sort(files.begin(), files.end());
+		for (const auto &file : files) {
+			const auto claimed = dir_ / "work" / file.filename();
+			fs::rename(file, claimed, error);
+			if (error) continue;
+			std::ifstream fin(claimed);
+			name = file.filename().string();
+			codes.clear();
+			fin >> depth;
+			fin.ignore(1);
+			std::getline(fin, codes);
+			return true;
+		}
+		return false;
+	}
+	// 手順の結果(solved<TAB>解答の移動の列/unsolvable/timeout/cancelled/error)を書く
+	void Report(const string &name, const string &result) const {
+		const auto temp = dir_ / "done" / (name + "." + tag_ + ".tmp");
+		{
+			std::ofstream fout(temp);
+			fout << result << '\n';
+		}
+		std::filesystem::rename(temp, dir_ / "done" / name);
+	}
+	// 探索中の手順の更新時刻を今にする(戻されていて、もうなければ何もしない)
+	void Heartbeat(const string &name) const {
+		std::error_code error;
+		std::filesystem::last_write_time(dir_ / "work" / name, std::filesystem::file_time_type::clock::now(), error);
+	}
+	// 着手済みで結果の出ていない手順のうち、更新時刻がkSpoolStaleMs以上変わらないものをtodo/に戻す(戻した数を返す)
+	// 更新時刻は作業者のマシンの時計で書かれるので今と比べず、seenに手順ごとの前回の更新時刻と、それが変わったのを見た時刻を持って判断する
+	size_t Requeue(std::map<string, std::pair<std::filesystem::file_time_type, std::chrono::high_resolution_clock::time_point>> &seen) const {
+		namespace fs = std::filesystem;
+		std::error_code error;
+		const auto now = std::chrono::high_resolution_clock::now();
+		vector<string> stale;
+		for (fs::directory_iterator it(dir_ / "work", error), end; !error && it != end; it.increment(error)) {
+			const auto name = it->path().filename().string();
+			if (it->path().extension() != ".txt" || fs::exists(dir_ / "done" / name)) continue;
+			std::error_code time_error;
+			const auto time = fs::last_write_time(it->path(), time_error);
+			if (time_error) continue;
+			const auto found = seen.find(name);
+			if (found == seen.end() || found->second.first != time) seen[name] = { time, now };
+			else if (now - found->second.second >= std::chrono::milliseconds(kSpoolStaleMs)) stale.push_back(name);
+		}
+		size_t count = 0;
+		for (const auto &name : stale) {
+			seen.erase(name);
+			std::error_code rename_error;
+			fs::rename(dir_ / "work" / name, dir_ / "todo" / name, rename_error);
+			if (!rename_error) ++count;
+		}
+		return count;
+	}
+	// phaseの手順の結果を集める(結果の出た数と、そのうち解けないと確かめた数を返す。解けた手順があればanswerに解答の移動の列を書く)
+	std::pair<size_t, size_t> Collect(const char phase, string &answer) const {
+		namespace fs = std::filesystem;
+		std::error_code error;
+		size_t finished = 0, proved = 0;
+		for (fs::directory_iterator it(dir_ / "done", error), end; !error && it != end; it.increment(error)) {
+			const auto file = it->path().filename().string();
+			if (file.empty() || file[0] != phase || it->path().extension() != ".txt") continue;
+			std::ifstream fin(it->path());
+			string result;
+			std::getline(fin, result);
+			++finished;
+			if (result == "unsolvable") ++proved;
+			if (result.compare(0, 7, "solved\t") == 0) answer = result.substr(7);
+		}
+		return { finished, proved };
 	}
 };
 
-int main(int argc, char *argv[]){
-	if(argc < 2) return -1;
-	int max_threads = 1;
-	bool must_combo_flg = false;
-	if (argc >= 3) {
-		max_threads = std::stoi(argv[2]);
-		if (max_threads == 0) {
-			max_threads = 1;
-		}else if (max_threads < 0) {
-			must_combo_flg = true;
-			max_threads = -max_threads;
-		}
-	}
-	Query query(argv[1], max_threads);
+// 一定間隔でcheckを呼ぶスレッド(checkがtrueを返すか、破棄されると止まる)
+class SpoolWatcher {
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	bool stop_flg_;
+	std::thread thread_;
+public:
+	explicit SpoolWatcher(std::function<bool()> check) : stop_flg_(false) {
+		thread_ = std::thread([this, check] {
+			std::unique_lock<std::mutex> lock(mutex_);
+			while (!cv_.wait_for(lock, std::chrono::milliseconds(kSpoolPollMs), [this] { return stop_flg_; })) {
+				if (check()) break;
+			}
+		});
+	}
+	~SpoolWatcher() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_flg_ = true;
+		}
+		cv_.notify_all();
+		thread_.join();
+	}
+};
+
+// 分担探索で、手順を1件ずつ取って、その続きをスレッドプールで探索する(調整役も手が空いていれば同じように探索する)
+template<size_t Words, size_t Width>
+class SpoolWorker {
+	const Spool &spool_;
+	const Query<Words, Width> &initial_;
+	TranspositionTable table_;
+	SearchContext<Words, Width> context_;
+	CancelToken cancel_;
+	// 前回探索した手順の鉢合わせの扱い(n/c。まだ探索していなければ0)
+	char phase_;
+	// 探索中の手順の名前(なければ空)と、その更新時刻を最後に今にした時刻(見張りのスレッドからも触るのでmutex_で守る)
+	std::mutex mutex_;
+	string claimed_;
+	std::chrono::high_resolution_clock::time_point beat_time_;
+public:
+	SpoolWorker(const Spool &spool, const Query<Words, Width> &initial, const Options &options)
+		: spool_(spool), initial_(initial), table_(options.table_megabytes_), context_(&table_), phase_(0) {
+		context_.SetLimit(options.limit_ms_);
+		context_.order_ = options.order_;
+		context_.cancel_ = &cancel_;
+	}
+	// 探索中の手順ごと、以降の手順を取らずに打ち切る
+	void Cancel() noexcept {
+		cancel_.Cancel();
+	}
+	bool Cancelled() const noexcept {
+		return cancel_.Cancelled();
+	}
+	// これまでに探索した手順の統計
+	const SearchContext<Words, Width> &Context() const noexcept {
+		return context_;
+	}
+	// 探索中の手順があれば、kSpoolHeartbeatMsごとにその更新時刻を今にする(見張りのスレッドから呼ぶ)
+	void Heartbeat() {
+		std::lock_guard<std::mutex> lock(mutex_);
+		const auto now = std::chrono::high_resolution_clock::now();
+		if (claimed_.empty() || now - beat_time_ < std::chrono::milliseconds(kSpoolHeartbeatMs)) return;
+		beat_time_ = now;
+		spool_.Heartbeat(claimed_);
+	}
+	// 1件取って探索し、結果を書く(取れる手順がなければfalse)
+	bool SolveOne() {
+		string name, codes;
+		size_t depth = 0;
+		if (cancel_.Cancelled() || context_.Expired() || !spool_.Claim(name, depth, codes)) return false;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			claimed_ = name;
+			beat_time_ = std::chrono::high_resolution_clock::now();
+		}
+		const bool combo_flg = (name[0] == 'c');
+		auto query = initial_;
+		string result = "error";
+		if (query.ApplyPrefix(codes, combo_flg)) {
+			context_.Reset();
+			// 置換表を空にするのは、鉢合わせの扱いが変わったときだけ(手順ごとに空にすると、それだけで探索より時間がかかる)
+			context_.keep_table_flg_ = (name[0] == phase_);
+			phase_ = name[0];
+			query.Start(&context_, combo_flg, depth);
+			g_pool->Wait();
+			result = query.TakeAnswer(context_) ? "solved\t" + query.MoveCodes() : context_.Cancelled() ? "cancelled" : context_.Expired() ? "timeout" : "unsolvable";
+		}
+		spool_.Report(name, result);
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			claimed_.clear();
+		}
+		return true;
+	}
+};
+
+// 分担探索の調整役として解く(問題は置いてある前提で、queryは最初の盤面、workerは調整役自身の作業者。経過はlogに書く)
+// 探索の最初の数手を、shards_件以上になるまで深さを増やしながら手順として書き出し、作業者(自分も含む)が1件ずつ取って続きを探索する
+// どれかの手順が解けるか時間切れになったら、stopを置いて全員を打ち切る。鉢合わせを考慮しない手順が全部解けなければ、考慮する手順を書き出し直す
+// 作業者が落ちて結果の出ない手順は、更新が止まってからkSpoolStaleMs後にtodo/に戻して、誰か(調整役も含む)に取り直させる
+// 解けたら解答をqueryに書き込む(解けなかった場合、時間切れならexpiredをtrueにする)。終わったらfinishを置く
+template<size_t Words, size_t Width>
+bool SolveSpool(Query<Words, Width> &query, const size_t max_depth, const Spool &spool, SpoolWorker<Words, Width> &worker, const Options &options, bool &expired, std::ostream &log) {
+	const Query<Words, Width> initial = query;
+	const auto process_begin_time = std::chrono::high_resolution_clock::now();
+	const auto deadline = (options.limit_ms_ == 0 ? std::chrono::high_resolution_clock::time_point::max() : process_begin_time + std::chrono::milliseconds(options.limit_ms_));
+	bool flg = false;
+	expired = false;
+	string answer;
+	for (const bool combo_flg : { false, true }) {
+		if (!combo_flg && options.must_combo_flg_) continue;
+		const char phase = (combo_flg ? 'c' : 'n');
+		// 手順を書き出す(手順を数えるうちに解けたら、それが解答)
+		SearchContext<Words, Width> collect(nullptr);
+		collect.deadline_ = deadline;
+		// 1手目から書き出しすぎる場合は、最初の局面を1件だけ置く
+		vector<string> prefixes{ initial.MoveCodes() };
+		size_t depth = 0;
+		for (size_t next = 1; next <= max_depth; ++next) {
+			collect.prefix_depth_ = next;
+			collect.prefixes_.clear();
+			flg = query.Solve(combo_flg, collect);
+			if (flg || collect.Expired() || collect.prefixes_.size() >= kMaxPrefixes) break;
+			prefixes = std::move(collect.prefixes_);
+			depth = next;
+			if (prefixes.size() >= options.shards_) break;
+		}
+		if (flg) {
+			log << "分担探索：手順を書き出すうちに解けました" << endl;
+			break;
+		}
+		if (collect.Expired()) {
+			expired = true;
+			break;
+		}
+		for (size_t pi = 0; pi < prefixes.size(); ++pi) spool.Post(phase, pi, depth, prefixes[pi]);
+		log << "分担探索：鉢合わせを考慮" << (combo_flg ? "する" : "しない") << "探索を、";
+		if (prefixes.empty()) log << "手順を書き出すうちに解けないと確かめました" << endl;
+		else log << "深さ" << depth << "までの" << prefixes.size() << "個の手順に分けました" << endl;
+		// 解けた手順を見つけるか時間切れになったら、全員を打ち切る
+		std::pair<size_t, size_t> progress;
+		{
+			std::map<string, std::pair<std::filesystem::file_time_type, std::chrono::high_resolution_clock::time_point>> seen;
+			SpoolWatcher watcher([&spool, &worker, &seen, &log, phase, deadline] {
+				worker.Heartbeat();
+				const size_t requeued = spool.Requeue(seen);
+				if (requeued > 0) log << "分担探索：結果の出ない手順を" << requeued << "個、未着手に戻しました" << endl;
+				string found;
+				spool.Collect(phase, found);
+				if (found.empty() && std::chrono::high_resolution_clock::now() < deadline) return false;
+				spool.Touch("stop");
+				worker.Cancel();
+				return true;
+			});
+			while (!worker.Cancelled()) {
+				progress = spool.Collect(phase, answer);
+				// 調整役自身が解いた場合も、見張りが次に見に来るのを待たずに全員を打ち切る
+				if (!answer.empty()) {
+					spool.Touch("stop");
+					break;
+				}
+				if (progress.first >= prefixes.size()) break;
+				if (!worker.SolveOne()) std::this_thread::sleep_for(std::chrono::milliseconds(kSpoolPollMs));
+			}
+		}
+		progress = spool.Collect(phase, answer);
+		if (!answer.empty()) {
+			flg = query.ApplyPrefix(answer, combo_flg);
+			break;
+		}
+		// 解けないと確かめられなかった手順があれば、鉢合わせを考慮する探索には進まない
+		if (worker.Cancelled() || progress.second < prefixes.size()) {
+			expired = true;
+			break;
+		}
+		if (!combo_flg) log << "..." << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - process_begin_time).count() << "[ms]..." << endl;
+	}
+	spool.Touch("finish");
+	return flg;
+}
+
+// 分担探索の調整役
+template<size_t Words, size_t Width>
+void RunSpool(std::shared_ptr<const Board> board, const Options &options, const long long startup_ms) {
+	const Spool spool(options.spool_dir_);
+	try {
+		std::ifstream fin(options.file_name_);
+		std::ostringstream puzzle;
+		puzzle << fin.rdbuf();
+		spool.Prepare(puzzle.str());
+	}
+	catch (const std::exception&) {
+		cout << "作業ディレクトリを用意できません." << endl;
+		return;
+	}
+	const size_t max_depth = board->max_depth_;
+	Query<Words, Width> query(std::move(board));
 	query.Put();
-	if (!must_combo_flg) {
-		const auto process_begin_time = std::chrono::high_resolution_clock::now();
-		bool flg = query.MoveNonCombo(0, 0);
-		auto process_end_time = std::chrono::high_resolution_clock::now();
+	const Query<Words, Width> initial = query;
+	SpoolWorker<Words, Width> worker(spool, initial, options);
+	const auto process_begin_time = std::chrono::high_resolution_clock::now();
+	bool expired;
+	const bool flg = SolveSpool(query, max_depth, spool, worker, options, expired, cout);
+	const auto process_end_time = std::chrono::high_resolution_clock::now();
+	if (flg) {
+		query.ShowAnswer();
+		SaveAnswer(query, options.answer_file_);
+	}
+	else if (expired) cout << "時間切れです." << endl;
+	cout << "前処理時間：" << startup_ms << "[ms]" << endl;
+	cout << "処理時間：" << std::chrono::duration_cast<std::chrono::milliseconds>(process_end_time - process_begin_time).count() << "[ms]\n" << endl;
+}
+
+// 分担探索の作業者(調整役がfinishを置くか、stopが置かれるまで、手順を取って探索し続ける)
+template<size_t Words, size_t Width>
+void RunWorker(std::shared_ptr<const Board> board, const Options &options, const Spool &spool) {
+	const Query<Words, Width> initial(std::move(board));
+	SpoolWorker<Words, Width> worker(spool, initial, options);
+	size_t solved = 0;
+	{
+		SpoolWatcher watcher([&spool, &worker] {
+			worker.Heartbeat();
+			if (!spool.Exists("stop")) return false;
+			worker.Cancel();
+			return true;
+		});
+		while (!worker.Cancelled()) {
+			if (worker.SolveOne()) {
+				++solved;
+				continue;
+			}
+			if (spool.Exists("finish")) break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(kSpoolPollMs));
+		}
+	}
+	cout << "分担探索：" << solved << "個の手順を探索しました" << endl;
+}
+
+// バッチモードで解く1問
+template<size_t Words, size_t Width>
+struct BatchJob {
+	string name_;
+	Query<Words, Width> query_;
+	SearchContext<Words, Width> context_;
+	// 鉢合わせを考慮して探索しているか
+	bool combo_flg_;
+	// 使っている置換表の番号
+	size_t slot_;
+	std::chrono::high_resolution_clock::time_point begin_time_;
+	BatchJob(const string &name, std::shared_ptr<const Board> board, TranspositionTable *table, const size_t slot)
+		: name_(name), query_(std::move(board)), context_(table), combo_flg_(false), slot_(slot) {}
+};
+
+// 複数の問題を1つのスレッドプールで同時に解き、解けた順に1問1行の結果を出力する
+// 出力は「名前<TAB>結果(solved/unsolvable/timeout/error)<TAB>鉢合わせ(combo/noncombo)<TAB>処理時間[ms]<TAB>ノード数<TAB>解答」で、
+// 解答は掃除人ごとの移動をU/D/L/Rの列にしてカンマで区切ったもの(errorの場合は理由)
+class BatchRunner {
+	const Options &options_;
+	// 同時に解く問題数だけ置換表を用意して使い回す
+	vector<std::unique_ptr<TranspositionTable>> tables_;
+	vector<size_t> free_slots_;
+	// 解いている問題(置換表の番号ごとに1問。結果を出力したら捨てるので、メモリは同時に解く問題数の分しか使わない)
+	vector<std::shared_ptr<void>> jobs_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	// 1問ぶんの結果を出力して、使っていた置換表を空け、問題を捨てる(mutex_を放してから捨てる)
+	void Report(const string &name, const char status[], const bool combo_flg, const long long ms, const uint64_t nodes, const string &answer, const size_t slot) {
+		std::shared_ptr<void> finished;
+		std::lock_guard<std::mutex> lock(mutex_);
+		cout << name << '\t' << status << '\t' << (combo_flg ? "combo" : "noncombo") << '\t' << ms << '\t' << nodes << '\t' << answer << endl;
+		if (slot != SIZE_MAX) {
+			finished = std::move(jobs_[slot]);
+			free_slots_.push_back(slot);
+		}
+		cv_.notify_all();
+	}
+	template<size_t Words, size_t Width>
+	void Start(const string &name, std::shared_ptr<const Board> board, const size_t slot) {
+		auto job = std::make_shared<BatchJob<Words, Width>>(name, std::move(board), tables_[slot].get(), slot);
+		auto *raw = job.get();
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			jobs_[slot] = job;
+		}
+		raw->combo_flg_ = options_.must_combo_flg_;
+		raw->begin_time_ = std::chrono::high_resolution_clock::now();
+		raw->context_.SetLimit(options_.limit_ms_);
+		raw->context_.order_ = options_.order_;
+		raw->context_.cover_flg_ = options_.cover_flg_;
+		raw->context_.on_finish_ = [this, raw] {
+			auto &context = raw->context_;
+			if (!context.answer_ && !context.Expired() && !raw->combo_flg_) {
+				// 鉢合わせを考慮せずには解けなかったので、考慮して解き直す
+				raw->combo_flg_ = true;
+				context.Reset();
+				raw->query_.Start(&context, true);
+				return;
+			}
+			const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - raw->begin_time_).count();
+			const char *status = (context.answer_ ? "solved" : context.Expired() ? "timeout" : "unsolvable");
+			const string answer = (context.answer_ ? context.answer_->MoveCodes() : "-");
+			// 問題はここで捨てられるので、以降はrawに触れない
+			Report(raw->name_, status, raw->combo_flg_, ms, context.nodes_, answer, raw->slot_);
+		};
+		raw->query_.Start(&raw->context_, raw->combo_flg_);
+	}
+public:
+	explicit BatchRunner(const Options &options) : options_(options) {
+		for (size_t si = 0; si < g_pool->Size(); ++si) {
+			tables_.push_back(std::make_unique<TranspositionTable>(options.table_megabytes_));
+			free_slots_.push_back(si);
+		}
+		jobs_.resize(tables_.size());
+	}
+	// 問題を1つ投入する(同時に解く問題数が上限に達していれば、どれかが解き終わるまで待つ)
+	void Add(const string &name, std::shared_ptr<const Board> board) {
+		size_t slot;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			cv_.wait(lock, [this] { return !free_slots_.empty(); });
+			slot = free_slots_.back();
+			free_slots_.pop_back();
+		}
+		const bool flg = DispatchSolver(*board, [this, &name, &board, slot](auto words, auto width) {
+			Start<decltype(words)::value, decltype(width)::value>(name, board, slot);
+		});
 		if (!flg) {
-			cout << "..." << std::chrono::duration_cast<std::chrono::milliseconds>(process_end_time - process_begin_time).count() << "[ms]..." << endl;
-			flg = query.MoveWithCombo(0, 0);
-			process_end_time = std::chrono::high_resolution_clock::now();
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				free_slots_.push_back(slot);
+			}
+			Error(name, "盤面が大きすぎます.");
+		}
+	}
+	// 読み込めなかった問題の結果を出力する
+	void Error(const string &name, const string &message) {
+		Report(name, "error", options_.must_combo_flg_, 0, 0, message, SIZE_MAX);
+	}
+	// 全問解き終わるまで待つ(結果を出力したタスクが抜けきるまで待つ)
+	void Wait() {
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			cv_.wait(lock, [this] { return free_slots_.size() == tables_.size(); });
+		}
+		g_pool->Wait();
+	}
+};
+
+// バッチモード(ディレクトリなら中の*.txtを名前順に、ファイルなら問題を続けて並べたパックとして読む)
+void RunBatch(const Options &options) {
+	namespace fs = std::filesystem;
+	BatchRunner runner(options);
+	if (fs::is_directory(options.file_name_)) {
+		vector<string> file_names;
+		for (const auto &entry : fs::directory_iterator(options.file_name_)) {
+			if (entry.is_regular_file() && entry.path().extension() == ".txt") file_names.push_back(entry.path().string());
+		}
+		std::sort(file_names.begin(), file_names.end());
+		for (const auto &file_name : file_names) {
+			std::shared_ptr<const Board> board;
+			try {
+				board = LoadBoard(file_name, options.landmark_flg_);
+			}
+			catch (const std::exception&) {
+				runner.Error(file_name, "問題データに誤りがあります.");
+				continue;
+			}
+			runner.Add(file_name, std::move(board));
 		}
-		if (flg) query.ShowAnswer();
-		cout << "処理時間：" << std::chrono::duration_cast<std::chrono::milliseconds>(process_end_time - process_begin_time).count() << "[ms]\n" << endl;
 	}
 	else {
-		const auto process_begin_time = std::chrono::high_resolution_clock::now();
-		bool flg = query.MoveWithCombo(0, 0);
-		const auto process_end_time = std::chrono::high_resolution_clock::now();
-		if (flg) query.ShowAnswer();
-		cout << "処理時間：" << std::chrono::duration_cast<std::chrono::milliseconds>(process_end_time - process_begin_time).count() << "[ms]\n" << endl;
+		std::ifstream fin;
+		fin.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+		try {
+			fin.open(options.file_name_);
+		}
+		catch (const std::exception&) {
+			runner.Error(options.file_name_, "ファイルを開けません.");
+			return;
+		}
+		for (size_t pi = 1; ; ++pi) {
+			const string name = options.file_name_ + "#" + std::to_string(pi);
+			std::shared_ptr<const Board> board;
+			try {
+				fin >> std::ws;
+				if (fin.eof()) break;
+				board = std::make_shared<const Board>(fin, options.landmark_flg_);
+			}
+			catch (const std::exception&) {
+				// 区切りが分からなくなるので、以降の問題は読まない
+				runner.Error(name, "問題データに誤りがあります.");
+				break;
+			}
+			runner.Add(name, std::move(board));
+		}
+	}
+	runner.Wait();
+}
+
+// ベンチマーク用に問題を生成する(specは「gen:横:縦:男の子:女の子:ロボット:歩数:乱数の種」)
+// 各掃除人をランダムウォークさせ、通ったマスを汚れた床(男の子が通ったマスは一部を水たまり)に、
+// 通らなかったマスを綺麗な床か障害物にするので、鉢合わせを考慮しなくても必ず解ける
+string GeneratePuzzle(const string &spec) {
+	vector<size_t> param;
+	std::istringstream fields(spec.substr(4));
+	string item;
+	while (std::getline(fields, item, ':')) param.push_back(std::stoul(item));
+	if (param.size() != 7) throw std::invalid_argument(spec);
+	const size_t x = param[0], y = param[1], steps = param[5];
+	const std::array<size_t, kCleanerTypes> counts = { param[2], param[3], param[4] };
+	if (x * y < counts[0] + counts[1] + counts[2] || x * y < 2) throw std::invalid_argument(spec);
+	uint64_t seed = param[6];
+	const auto random = [&seed](const size_t n) {
+		// splitmix64
+		uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return static_cast<size_t>((z ^ (z >> 31)) % n);
+	};
+	// 初期位置を重ならないように決めてから、1人ずつ歩かせる
+	vector<size_t> floor(x * y, SIZE_MAX);
+	vector<char> visited(x * y, 0), boy_visited(x * y, 0);
+	const size_t codes[kCleanerTypes] = { 2, 3, 4 };
+	for (size_t ti = 0; ti < kCleanerTypes; ++ti) {
+		for (size_t ci = 0; ci < counts[ti]; ++ci) {
+			size_t position;
+			do {
+				position = random(x * y);
+			} while (floor[position] != SIZE_MAX);
+			floor[position] = codes[ti];
+			size_t old_position = position;
+			for (size_t si = 0; si < steps; ++si) {
+				std::array<size_t, kDirections> next_position;
+				size_t count = 0;
+				const size_t i = position % x, j = position / x;
+				if (j > 0) next_position[count++] = position - x;
+				if (i > 0) next_position[count++] = position - 1;
+				if (i + 1 < x) next_position[count++] = position + 1;
+				if (j + 1 < y) next_position[count++] = position + x;
+				// すぐ前にいたマスには戻れない(行き止まりは盤面の端にしかないので、候補は必ず残る)
+				const size_t back = std::find(next_position.begin(), next_position.begin() + count, old_position) - next_position.begin();
+				if (back < count) next_position[back] = next_position[--count];
+				old_position = position;
+				position = next_position[random(count)];
+				visited[position] = 1;
+				if (ti == 0) boy_visited[position] = 1;
+			}
+		}
+	}
+	std::ostringstream puzzle;
+	puzzle << x << " " << y << "\n";
+	for (size_t position = 0; position < x * y; ++position) {
+		if (floor[position] == SIZE_MAX) {
+			if (boy_visited[position] != 0 && random(4) == 0) {
+				floor[position] = 5;
+			}
+			else if (visited[position] != 0) {
+				floor[position] = 0;
+			}
+			else {
+				floor[position] = (random(10) < 3 ? 10 : 1);
+			}
+		}
+		puzzle << floor[position] << (position % x + 1 == x ? "\n" : " ");
+	}
+	for (size_t ti = 0; ti < kCleanerTypes; ++ti) {
+		puzzle << counts[ti];
+		for (size_t ci = 0; ci < counts[ti]; ++ci) puzzle << " " << steps;
+		puzzle << "\n";
+	}
+	return puzzle.str();
+}
+
+// ベンチマークで基準値より遅いとみなす比率と、処理時間の差の下限(短い件の揺らぎは見逃す)
+const double kBenchTolerance = 1.25;
+const double kBenchMinDiffMs = 10;
+
+// ベンチマークでの解き方
+enum class BenchMethod {
+	Dfs,	//深さ優先探索
+	Cover,	//被覆エンジン(深さ優先探索でも解き、結果と各掃除人の歩数が同じか確かめる)
+	Total,	//全員の歩数の合計を最小にする最適化モード(見つけた解のコストが歩数と合うか確かめる)
+	Makespan,	//最後の掃除人が歩き終えるまでの歩数を最小にする最適化モード(同上)
+	Landmark,	//大きな盤面と同じく、目印のマスからの最小移動歩数で下界を求める深さ優先探索
+	Decompose,	//掃除人を互いにかち合わない組に分けて解く(組に分かれない問題は一覧の誤り)
+	Spool,		//一時ディレクトリを作業ディレクトリにして、作業者を置かずに調整役だけで分担探索する
+};
+
+// ベンチマークの1件(問題・鉢合わせの扱い・制限時間・解き方)
+struct BenchCase {
+	string name_;
+	string source_;
+	bool combo_flg_;
+	size_t limit_ms_;
+	BenchMethod method_;
+	// 問題ファイルの中身と、それを読んだ盤面
+	string puzzle_;
+	std::shared_ptr<const Board> board_;
+};
+
+// ベンチマークの1回ぶんの結果(解答を歩かせ直して誤りがあれば、statusはinvalidで、errorにその理由)
+struct BenchResult {
+	string status_;
+	long long ms_;
+	uint64_t nodes_, prune_checks_, prune_hits_;
+	string error_;
+};
+
+// 移動の列(MoveCodesの形式)から、掃除人ごとの歩数
+vector<size_t> StepCounts(const string &codes) {
+	vector<size_t> counts(1, 0);
+	for (const char code : codes) {
+		if (code == ',') counts.push_back(0);
+		else ++counts.back();
+	}
+	return counts;
+}
+
+// 1件を1回解いて、処理時間と探索の統計を測る
+template<size_t Words, size_t Width>
+BenchResult BenchOnce(const BenchCase &bench_case, TranspositionTable &table, const Options &options) {
+	Query<Words, Width> query(bench_case.board_);
+	SearchContext<Words, Width> context(&table);
+	context.order_ = options.order_;
+	context.cover_flg_ = options.cover_flg_ || bench_case.method_ == BenchMethod::Cover;
+	const auto begin_time = std::chrono::high_resolution_clock::now();
+	context.SetLimit(bench_case.limit_ms_);
+	const bool optimize_flg = (bench_case.method_ == BenchMethod::Total || bench_case.method_ == BenchMethod::Makespan);
+	bool flg;
+	if (bench_case.method_ == BenchMethod::Decompose) {
+		// 通常の実行と同じく組ごとに解く(鉢合わせを考慮するなら、考慮する探索だけ)
+		// 部分問題の盤面と置換表は、通常の実行と同じく時間を測る前に作る
+		Options part_options = options;
+		part_options.limit_ms_ = bench_case.limit_ms_;
+		part_options.must_combo_flg_ = bench_case.combo_flg_;
+		part_options.objective_ = Objective::None;
+		part_options.progress_ms_ = 0;
+		Decomposition<Words, Width> decomposition(*bench_case.board_, bench_case.board_->Decompose(), part_options);
+		vector<string> phases;
+		bool expired;
+		size_t best_cost;
+		const auto part_begin_time = std::chrono::high_resolution_clock::now();
+		flg = decomposition.Solve(query, phases, expired, best_cost);
+		const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - part_begin_time).count();
+		const auto counts = decomposition.Counts();
+		const string error = (flg ? query.CheckAnswer(true) : "");
+		return BenchResult{ !error.empty() ? "invalid" : flg ? "solved" : expired ? "timeout" : "unsolvable", ms, std::get<0>(counts), std::get<1>(counts), std::get<2>(counts), error };
+	}
+	if (bench_case.method_ == BenchMethod::Spool) {
+		// 通常の実行と同じ流れで解く(鉢合わせを考慮するなら、考慮する探索だけ)。経過の表示は捨てる
+		Options spool_options = options;
+		spool_options.limit_ms_ = bench_case.limit_ms_;
+		spool_options.must_combo_flg_ = bench_case.combo_flg_;
+		const auto spool_dir = std::filesystem::temp_directory_path() / "SweepOptimizer-bench-spool";
+		const Spool spool(spool_dir.string());
+		try {
+			spool.Prepare(bench_case.puzzle_);
+		}
+		catch (const std::exception&) {
+			return BenchResult{ "invalid", 0, 0, 0, 0, spool_dir.string() + "を用意できません" };
+		}
+		const Query<Words, Width> initial = query;
+		SpoolWorker<Words, Width> worker(spool, initial, spool_options);
+		std::ostringstream log;
+		bool expired;
+		const auto spool_begin_time = std::chrono::high_resolution_clock::now();
+		flg = SolveSpool(query, bench_case.board_->max_depth_, spool, worker, spool_options, expired, log);
+		const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - spool_begin_time).count();
+		std::error_code error_code;
+		std::filesystem::remove_all(spool_dir, error_code);
+		const auto &spool_context = worker.Context();
+		const string error = (flg ? query.CheckAnswer(true) : "");
+		return BenchResult{ !error.empty() ? "invalid" : flg ? "solved" : expired ? "timeout" : "unsolvable", ms, spool_context.nodes_, spool_context.prune_checks_, spool_context.prune_hits_, error };
+	}
+	if (optimize_flg) {
+		// 最適化モードは通常の実行と同じ流れで解く(鉢合わせを考慮するなら、考慮する探索だけ)
+		context.objective_ = (bench_case.method_ == BenchMethod::Total ? Objective::Total : Objective::Makespan);
+		flg = SolveOptimized(query, context, bench_case.combo_flg_, [&query, &context](const bool combo_flg) { return query.Solve(combo_flg, context); });
+	}
+	else {
+		flg = query.Solve(bench_case.combo_flg_, context);
+	}
+	const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - begin_time).count();
+	// 最適化モードで時間切れなら、解は見つかっていても最小と確かめられていないので時間切れとする
+	const string status = (flg && !(optimize_flg && context.Expired()) ? "solved" : context.Expired() ? "timeout" : "unsolvable");
+	string error = (flg ? query.CheckAnswer(!optimize_flg) : "");
+	if (error.empty() && flg && optimize_flg) {
+		size_t cost = 0;
+		for (const auto count : StepCounts(query.MoveCodes())) cost = (context.objective_ == Objective::Makespan ? std::max(cost, count) : cost + count);
+		if (cost != context.best_cost_) error = "コスト(" + std::to_string(context.best_cost_) + "歩)が歩数(" + std::to_string(cost) + "歩)と合いません";
+	}
+	if (error.empty() && bench_case.method_ == BenchMethod::Cover && !context.Expired()) {
+		// 深さ優先探索でも解いて比べる(時間は測らない)
+		Query<Words, Width> reference(bench_case.board_);
+		SearchContext<Words, Width> reference_context(&table);
+		reference_context.order_ = options.order_;
+		reference_context.SetLimit(bench_case.limit_ms_);
+		const bool reference_flg = reference.Solve(bench_case.combo_flg_, reference_context);
+		if (!reference_context.Expired()) {
+			if (reference_flg != flg) error = string("深さ優先探索では") + (reference_flg ? "解けます" : "解けません");
+			else if (flg && StepCounts(query.MoveCodes()) != StepCounts(reference.MoveCodes())) error = "深さ優先探索と歩数が違います";
+		}
+	}
+	return BenchResult{ error.empty() ? status : "invalid", ms, context.nodes_, context.prune_checks_, context.prune_hits_, error };
+}
+
+// ベンチマークの一覧ファイルを読む(1行1件で「名前 問題 鉢合わせ(combo/noncombo) 制限時間[ms] [解き方]」、#以降は注釈)
+// 問題は一覧ファイルからの相対パスか、GeneratePuzzleに渡す「gen:...」
+// 解き方はdfs(省略時)・cover(鉢合わせを考慮しない場合だけ)・total・makespan(最適化モード。comboなら鉢合わせを考慮する探索だけを行う)・landmark・decompose・spool
+vector<BenchCase> LoadBenchCorpus(const string &file_name) {
+	std::ifstream fin(file_name);
+	if (!fin) throw std::runtime_error(file_name + "を開けません.");
+	const auto base_dir = std::filesystem::path(file_name).parent_path();
+	vector<BenchCase> corpus;
+	string line;
+	while (std::getline(fin, line)) {
+		line = line.substr(0, line.find('#'));
+		std::istringstream fields(line);
+		BenchCase bench_case;
+		string mode, method = "dfs";
+		if (!(fields >> bench_case.name_)) continue;
+		if (!(fields >> bench_case.source_ >> mode >> bench_case.limit_ms_) || (mode != "combo" && mode != "noncombo")) {
+			throw std::runtime_error(file_name + "の「" + line + "」が読めません.");
+		}
+		bench_case.combo_flg_ = (mode == "combo");
+		fields >> method;
+		if (method == "dfs") {
+			bench_case.method_ = BenchMethod::Dfs;
+		}
+		else if (method == "cover" && !bench_case.combo_flg_) {
+			bench_case.method_ = BenchMethod::Cover;
+		}
+		else if (method == "total") {
+			bench_case.method_ = BenchMethod::Total;
+		}
+		else if (method == "makespan") {
+			bench_case.method_ = BenchMethod::Makespan;
+		}
+		else if (method == "landmark") {
+			bench_case.method_ = BenchMethod::Landmark;
+		}
+		else if (method == "decompose") {
+			bench_case.method_ = BenchMethod::Decompose;
+		}
+		else if (method == "spool") {
+			bench_case.method_ = BenchMethod::Spool;
+		}
+		else {
+			throw std::runtime_error(file_name + "の「" + line + "」の解き方が読めません.");
+		}
+		// 分担探索では問題ファイルの中身を作業ディレクトリに置くので、中身を読んでから盤面を作る
+		if (bench_case.source_.compare(0, 4, "gen:") == 0) {
+			bench_case.puzzle_ = GeneratePuzzle(bench_case.source_);
+		}
+		else {
+			std::ifstream source(base_dir / bench_case.source_);
+			if (!source) throw std::runtime_error((base_dir / bench_case.source_).string() + "を開けません.");
+			std::ostringstream text;
+			text << source.rdbuf();
+			bench_case.puzzle_ = text.str();
+		}
+		std::istringstream puzzle(bench_case.puzzle_);
+		puzzle.exceptions(std::istream::failbit | std::istream::badbit);
+		bench_case.board_ = std::make_shared<const Board>(puzzle, bench_case.method_ == BenchMethod::Landmark);
+		if (bench_case.method_ == BenchMethod::Decompose && bench_case.board_->Decompose().size() < 2) {
+			throw std::runtime_error(file_name + "の「" + line + "」は組に分かれません.");
+		}
+		corpus.push_back(std::move(bench_case));
+	}
+	return corpus;
+}
+
+// ベンチマークモード(一覧の各件をスレッド数ごとにrepeat_回解き、中央値を出力して基準値と比べる)
+// 出力は「名前<TAB>鉢合わせ<TAB>スレッド数<TAB>結果<TAB>処理時間[ms]<TAB>ノード数<TAB>ノード/秒<TAB>枝刈り率[%]」で、
+// 基準値があれば「基準比」と、時間切れになった・遅くなった場合は「退行」を、時間切れでなくなった場合は「改善」を、
+// 解けた・解けないが入れ替わった場合は「結果相違」を付け足す。解答を歩かせ直して誤りがあれば、基準値によらず「解答誤り」とその理由を付け足す
+// (退行・結果相違・解答誤りのどれかがあれば終了コードは1)
+int RunBench(const Options &options) {
+	vector<BenchCase> corpus;
+	try {
+		corpus = LoadBenchCorpus(options.file_name_);
+	}
+	catch (const std::exception &e) {
+		cout << e.what() << endl;
+		return -1;
+	}
+	// 基準値は保存した結果そのもの(キーは名前・鉢合わせ・スレッド数)
+	std::map<string, vector<string>> baseline;
+	if (!options.baseline_file_.empty()) {
+		std::ifstream fin(options.baseline_file_);
+		if (!fin) {
+			cout << options.baseline_file_ << "を開けません." << endl;
+			return -1;
+		}
+		string line;
+		while (std::getline(fin, line)) {
+			if (line.empty() || line[0] == '#') continue;
+			vector<string> fields;
+			std::istringstream list(line);
+			string item;
+			while (std::getline(list, item, '\t')) fields.push_back(item);
+			if (fields.size() < 8) continue;
+			baseline[fields[0] + "\t" + fields[1] + "\t" + fields[2]] = fields;
+		}
+	}
+	std::ostringstream saved;
+	saved << "#名前\t鉢合わせ\tスレッド数\t結果\t処理時間[ms]\tノード数\tノード/秒\t枝刈り率[%]" << endl;
+	cout << saved.str();
+	TranspositionTable table(options.table_megabytes_);
+	bool regression_flg = false;
+	for (const auto threads : options.bench_threads_) {
+		WorkStealingPool pool(threads);
+		g_pool = &pool;
+		for (const auto &bench_case : corpus) {
+			const auto run = [&bench_case, &table, &options] {
+				vector<BenchResult> results;
+				for (size_t ri = 0; ri < options.repeat_; ++ri) {
+					// 前の回の置換表を引き継ぐと2回目以降だけ速くなるので、毎回空にしてから解く(時間は測らない)
+					table.Clear();
+					DispatchSolver(*bench_case.board_, [&bench_case, &table, &results, &options](auto words, auto width) {
+						results.push_back(BenchOnce<decltype(words)::value, decltype(width)::value>(bench_case, table, options));
+					});
+				}
+				return results;
+			};
+			const auto results = run();
+			if (results.empty()) {
+				cout << bench_case.name_ << "\t盤面が大きすぎます." << endl;
+				continue;
+			}
+			// 処理時間・ノード数・枝刈り率はそれぞれ中央値を取る
+			const auto median = [&results](auto key) {
+				vector<decltype(key(results[0]))> values;
+				for (const auto &result : results) values.push_back(key(result));
+				std::sort(values.begin(), values.end());
+				return values[values.size() / 2];
+			};
+			const auto ms = median([](const BenchResult &result) { return result.ms_; });
+			const auto nodes = median([](const BenchResult &result) { return result.nodes_; });
+			const auto rate = median([](const BenchResult &result) {
+				return result.nodes_ * 1000.0 / std::max<long long>(result.ms_, 1);
+			});
+			const auto prune_rate = median([](const BenchResult &result) {
+				return result.prune_checks_ == 0 ? 0.0 : result.prune_hits_ * 100.0 / result.prune_checks_;
+			});
+			std::ostringstream line;
+			line << bench_case.name_ << "\t" << (bench_case.combo_flg_ ? "combo" : "noncombo") << "\t" << threads << "\t" << results[results.size() / 2].status_
+				<< "\t" << ms << "\t" << nodes << "\t" << static_cast<uint64_t>(rate) << "\t" << std::fixed << std::setprecision(1) << prune_rate;
+			saved << line.str() << endl;
+			cout << line.str();
+			const auto invalid = std::find_if(results.begin(), results.end(), [](const BenchResult &result) { return !result.error_.empty(); });
+			if (invalid != results.end()) {
+				cout << "\t解答誤り(" << invalid->error_ << ")";
+				regression_flg = true;
+			}
+			// 時間切れの件は処理時間が制限時間で決まるので、ノード/秒で比べる
+			// (基準値で時間切れだった件が解けた・解けないと確かめられた場合は、ノード/秒が落ちても改善とみなす)
+			const auto base = baseline.find(bench_case.name_ + "\t" + (bench_case.combo_flg_ ? "combo" : "noncombo") + "\t" + std::to_string(threads));
+			if (base != baseline.end()) {
+				const auto &fields = base->second;
+				const auto &status = results[results.size() / 2].status_;
+				const bool timeout_flg = (fields[3] == "timeout");
+				const double base_value = std::stod(timeout_flg ? fields[6] : fields[4]);
+				const double value = (timeout_flg ? rate : static_cast<double>(ms));
+				const double ratio = (timeout_flg ? base_value / std::max(value, 1.0) : value / std::max(base_value, 1.0));
+				cout << "\t基準比x" << std::fixed << std::setprecision(2) << ratio;
+				if (timeout_flg && status != "timeout") {
+					cout << "\t改善";
+				}
+				else if (!timeout_flg && status != "timeout" && status != fields[3]) {
+					// 解ける・解けないが入れ替わるのは速さの問題ではない
+					cout << "\t結果相違";
+					regression_flg = true;
+				}
+				else if (status == "timeout" && !timeout_flg) {
+					cout << "\t退行";
+					regression_flg = true;
+				}
+				else if (ratio > kBenchTolerance && (timeout_flg || ms - base_value >= kBenchMinDiffMs)) {
+					// 処理時間で比べる件は一時的な揺らぎかもしれないので、同じ回数解き直して処理時間を並べて示し、解き直しても遅ければ退行とする
+					bool slow_flg = true;
+					if (!timeout_flg) {
+						const auto retry = run();
+						vector<long long> values;
+						for (const auto &result : retry) values.push_back(result.ms_);
+						std::sort(values.begin(), values.end());
+						const long long retry_ms = values[values.size() / 2];
+						const double retry_ratio = retry_ms / std::max(base_value, 1.0);
+						cout << "\t再測定" << retry_ms << "[ms](基準比x" << retry_ratio << ")";
+						slow_flg = (retry[retry.size() / 2].status_ != status || (retry_ratio > kBenchTolerance && retry_ms - base_value >= kBenchMinDiffMs));
+						const auto retry_invalid = std::find_if(retry.begin(), retry.end(), [](const BenchResult &result) { return !result.error_.empty(); });
+						if (retry_invalid != retry.end()) {
+							cout << "\t解答誤り(" << retry_invalid->error_ << ")";
+							regression_flg = true;
+						}
+					}
+					if (slow_flg) {
+						cout << "\t退行";
+						regression_flg = true;
+					}
+				}
+			}
+			cout << endl;
+		}
+	}
+	g_pool = nullptr;
+	if (!options.save_file_.empty()) {
+		std::ofstream fout(options.save_file_);
+		fout << saved.str();
+	}
+	return regression_flg ? 1 : 0;
+}
+
+int main(int argc, char *argv[]){
+	Options options;
+	if (!ParseOptions(argc, argv, options)) {
+		cout << "usage: SweepOptimizer input.txt [threads] [--tt=MB] [--limit=ms] [--progress=ms] [--stats=file.json] [--order=name] [--engine=cover|dfs] [--portfolio[=name,...]] [--answer=file.json|file.bin] [--count[=k]] [--solutions=file] [--optimize[=total|makespan]] [--large] [--spool=dir [--shards=N]]" << endl;
+		cout << "       SweepOptimizer --batch directory|pack.txt [threads] [--tt=MB] [--limit=ms] [--order=name] [--engine=cover|dfs] [--large]" << endl;
+		cout << "       SweepOptimizer --worker spool_dir [threads] [--tt=MB] [--limit=ms] [--order=name] [--large]" << endl;
+		cout << "       SweepOptimizer --bench corpus.txt [--threads=1,2,4] [--repeat=N] [--baseline=file] [--save=file] [--tt=MB] [--order=name] [--engine=cover|dfs]" << endl;
+		return -1;
+	}
+	if (options.bench_flg_) return RunBench(options);
+	WorkStealingPool pool(options.max_threads_);
+	g_pool = &pool;
+	if (options.batch_flg_) {
+		RunBatch(options);
+		return 0;
+	}
+	if (options.worker_flg_) {
+		// 調整役が問題を置くまで待つ
+		const Spool spool(options.file_name_);
+		while (!spool.Exists("puzzle.txt")) std::this_thread::sleep_for(std::chrono::milliseconds(kSpoolPollMs));
+		std::shared_ptr<const Board> board;
+		try {
+			board = LoadBoard(spool.Path("puzzle.txt").string(), options.landmark_flg_);
+		}
+		catch (const std::exception&) {
+			cout << "問題データに誤りがあります." << endl;
+			return -1;
+		}
+		if (!DispatchSolver(*board, [&board, &options, &spool](auto words, auto width) {
+			RunWorker<decltype(words)::value, decltype(width)::value>(std::move(board), options, spool);
+		})) {
+			cout << "盤面が大きすぎます." << endl;
+			return -1;
+		}
+		return 0;
+	}
+	const auto startup_begin_time = std::chrono::high_resolution_clock::now();
+	std::shared_ptr<const Board> board;
+	try {
+		board = LoadBoard(options.file_name_, options.landmark_flg_);
+	}
+	catch (const std::exception&) {
+		cout << "問題データに誤りがあります." << endl;
+		return -1;
+	}
+	const auto startup_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - startup_begin_time).count();
+	if (!DispatchSolver(*board, [&board, &options, startup_ms](auto words, auto width) {
+		if (options.spool_dir_.empty()) Run<decltype(words)::value, decltype(width)::value>(std::move(board), options, startup_ms);
+		else RunSpool<decltype(words)::value, decltype(width)::value>(std::move(board), options, startup_ms);
+	})) {
+		cout << "盤面が大きすぎます." << endl;
+		return -1;
 	}
 return 0;
 }